@@ -1,3 +1,4 @@
+#include <csignal>
 #include <iostream>
 #include <fstream>
 #include <thread>
@@ -13,7 +14,6 @@
 
 /*
  * Simplify MM and GC
- * Load and store image
  * Primitives: list files / load file / store file / exit VM
  * Cleanup context switch
  * Built-in compiler
@@ -21,7 +21,52 @@
  */
 
 int main() {
-    pimii::MemoryManager::initialize("");
+    // The maximal heap size (in MB) and the use of huge pages ("transparent" or "explicit") can be
+    // specified via the environment...
+    pimii::Word maximumHeapSize = pimii::MemoryManager::DEFAULT_HEAP_SIZE;
+    const char* heapSize = getenv("PIMII_HEAP_SIZE");
+    if (heapSize != nullptr) {
+        maximumHeapSize = std::strtoul(heapSize, nullptr, 10) * 1024 * 1024 / sizeof(pimii::Word);
+    }
+
+    pimii::HugePages pageMode = pimii::HugePages::NONE;
+    const char* hugePages = getenv("PIMII_HUGE_PAGES");
+    if (hugePages != nullptr) {
+        pageMode = std::string(hugePages) == "explicit" ? pimii::HugePages::EXPLICIT : pimii::HugePages::TRANSPARENT;
+    }
+
+    // Starts from the given image if it exists. Otherwise the system is bootstrapped from source.st and then stored
+    // as image, so that the next start only has to map it...
+    const char* image = getenv("PIMII_IMAGE");
+    bool loadImage = image != nullptr && std::ifstream(image).good();
+    pimii::MemoryManager::initialize(loadImage ? image : "", maximumHeapSize, pageMode);
+
+    // Crossing the soft limit (in MB) forces a full GC and signals the LowSpaceSemaphore, allocating beyond the
+    // hard limit fails...
+    pimii::Word softLimit = maximumHeapSize / 4 * 3;
+    pimii::Word hardLimit = pimii::MemoryManager::NO_HEAP_LIMIT;
+    const char* softHeapLimit = getenv("PIMII_SOFT_HEAP_LIMIT");
+    if (softHeapLimit != nullptr) {
+        softLimit = std::strtoul(softHeapLimit, nullptr, 10) * 1024 * 1024 / sizeof(pimii::Word);
+    }
+    const char* hardHeapLimit = getenv("PIMII_HARD_HEAP_LIMIT");
+    if (hardHeapLimit != nullptr) {
+        hardLimit = std::strtoul(hardHeapLimit, nullptr, 10) * 1024 * 1024 / sizeof(pimii::Word);
+    }
+    pimii::MemoryManager::setHeapLimits(softLimit, hardLimit);
+
+    // Logs each collection along with its pause time...
+    const char* gcLog = getenv("PIMII_GC_LOG");
+    if (gcLog != nullptr) {
+        pimii::MemoryManager::logCollections(gcLog);
+    }
+
+    // Limits each incremental marking step to the given number of microseconds...
+    const char* markingStepMicros = getenv("PIMII_MARKING_STEP_MICROS");
+    if (markingStepMicros != nullptr) {
+        pimii::MemoryManager::setMarkingStepBudget(
+                static_cast<pimii::SmallInteger>(std::strtol(markingStepMicros, nullptr, 10)));
+    }
 
     std::cout << pimii::SmallIntegers::minSmallInt() << std::endl;
     std::cout << pimii::SmallIntegers::maxSmallInt() << std::endl;
@@ -33,14 +78,20 @@ int main() {
 //        token = tokenizer.consume();
 //    }
 //
-    pimii::System sys;
-    std::ifstream ifs("source.st");
-    std::string content;
-    content.assign(std::istreambuf_iterator<char>(ifs),
-                   std::istreambuf_iterator<char>());
+    pimii::System sys = loadImage ? pimii::System(pimii::MemoryManager::imageRoots()) : pimii::System();
+    if (!loadImage) {
+        std::ifstream ifs("source.st");
+        std::string content;
+        content.assign(std::istreambuf_iterator<char>(ifs),
+                       std::istreambuf_iterator<char>());
 
-    pimii::SourceFileParser parser(sys, content);
-    parser.compile();
+        pimii::SourceFileParser parser(sys, content);
+        parser.compile();
+
+        if (image != nullptr) {
+            sys.memoryManager().saveImage(image, sys.imageRoots());
+        }
+    }
 
 
     std::vector<pimii::Error> errors;
@@ -57,6 +108,20 @@ int main() {
     //pimii::Compiler compiler("xx [ :a :b | a + b] value: 3 value: 4", pimii::Nil::NIL);
 //    pimii::ObjectPointer method = compiler.compile(sys);
     pimii::Interpreter interpreter(sys);
+
+    // Samples the allocations and writes them as folded stacks into the given file once the VM stops...
+    const char* allocationProfile = getenv("PIMII_ALLOCATION_PROFILE");
+    if (allocationProfile != nullptr) {
+        const char* sampleBytes = getenv("PIMII_ALLOCATION_SAMPLE_BYTES");
+        interpreter.profileAllocations(sampleBytes != nullptr ? std::strtoul(sampleBytes, nullptr, 10)
+                                                              : pimii::AllocationProfiler::DEFAULT_INTERVAL_BYTES);
+    }
+
+    // Writes a heap dump into the given file whenever SIGUSR1 is received (analyze it using pimii-heapdump)...
+    const char* heapDump = getenv("PIMII_HEAP_DUMP");
+    if (heapDump != nullptr) {
+        interpreter.dumpHeapOnSignal(SIGUSR1, heapDump);
+    }
     pimii::ObjectPointer context = sys.memoryManager().makeObject(pimii::System::CONTEXT_SIZE,
                                                                   pimii::Nil::NIL);
     context[pimii::System::CONTEXT_IP_FIELD] = pimii::ObjectPointer::forSmallInt(0);
@@ -119,7 +184,18 @@ int main() {
                     << std::endl;
             ctx = ctx[pimii::System::CONTEXT_SENDER_FIELD];
         }
+
+        // Lists the classes which occupy the most memory (e.g. after running out of memory)...
+        const char* census = getenv("PIMII_CENSUS");
+        if (census != nullptr) {
+            sys.printCensus(std::cout, std::strtoul(census, nullptr, 10));
+        }
     }
+    if (allocationProfile != nullptr) {
+        std::ofstream out(allocationProfile);
+        interpreter.allocationProfile().write(out);
+    }
+
     std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
     std::cout << "Took: " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "us"
               << std::endl;
@@ -6,7 +6,11 @@
 #define MEM_OBJECTPOINTER_H
 
 #include <string>
+#include <vector>
+#include <type_traits>
 #include <iostream>
+#include <cstring>
+#include <cassert>
 
 #include "types.h"
 
@@ -19,29 +23,31 @@ namespace pimii {
         constexpr static Word ODD_MASK = 0x0F;
         constexpr static Word GC_MASK = 0xF0;
 
-        static constexpr SmallInteger usableSizeBytes() {
-            return sizeof(Word) - 1;
-        }
-
-        constexpr Word sizeMask() const {
-            Word mask = 0x00;
-            for (int i = 0; i < usableSizeBytes(); i++) {
-                mask = mask << 8;
-                mask |= 0xFF;
-            }
-
-            return mask;
-        }
-
-        constexpr Word clearGCMask() const {
-            Word mask = 0x0F;
-            for (int i = 0; i < usableSizeBytes(); i++) {
-                mask = mask << 8;
-                mask |= 0xFF;
-            }
-
-            return mask;
-        }
+        /**
+         * The lower three bytes of the size header contain the size, the highest byte contains the GC state and the
+         * odd bytes of a buffer.
+         */
+        constexpr static uint32_t SIZE_MASK = 0x00FFFFFF;
+        constexpr static uint32_t FLAGS_SHIFT = 24;
+
+        /**
+         * The lower bits of the class header contain the index of the type in the classTable. The remaining bits
+         * contain the identity hash of the object (see id()). Identity hashed tables probe linearly from the hash,
+         * therefore most bits are spent on it: this permits 4095 classes and about a million distinct hashes.
+         * <p>
+         * A 20 bit class index would only leave 12 bits for the hash, as the size header is fully used and another
+         * header word would cost as much as the compact header saves. As a bootstrapped image uses only 55
+         * classes, we trade the range of the class index for the quality of the hash. Raising CLASS_INDEX_BITS is
+         * all it takes to shift this balance.
+         */
+        constexpr static uint32_t CLASS_INDEX_BITS = 12;
+        constexpr static uint32_t CLASS_INDEX_MASK = (1 << CLASS_INDEX_BITS) - 1;
+        constexpr static uint32_t HASH_MASK = ~CLASS_INDEX_MASK;
+
+        /**
+         * Contains the state of the generator for identity hashes (see id()).
+         */
+        static uint32_t lastHash;
 
         enum ObjectPointerType : Word {
             OBJECT = 0,
@@ -50,12 +56,24 @@ namespace pimii {
             DECIMAL = 3
         };
 
+        /**
+         * Each object starts with a 64 bit header, which is a single word (or two if compressed pointers are used).
+         * During a GC, the class header is used to store the index of the gcSuccessor.
+         */
         struct Object {
-            Word size;
-            Word type;
+            uint32_t size;
+            uint32_t classIndex;
             Word fields[];
         };
 
+        /**
+         * Is stored in place of the bytes of an external buffer (see FORMAT_EXTERNAL).
+         */
+        struct ExternalBytes {
+            char* bytes;
+            uint64_t length;
+        };
+
         Word data;
 
 
@@ -68,7 +86,7 @@ namespace pimii {
                 throw std::bad_cast();
             }
 
-            return reinterpret_cast<Object*> (baseAddress + (data & ~TYPE_MASK));
+            return reinterpret_cast<Object*> (baseAddress + index());
         }
 
         inline Object* object() const {
@@ -88,15 +106,109 @@ namespace pimii {
         }
 
         SmallInteger highNibble() const {
-            return pointer()->size >> (usableSizeBytes() * 8);
+            return pointer()->size >> FLAGS_SHIFT;
+        }
+
+        /**
+         * Returns the format of an object, which shares the "odd" nibble with buffers (see FORMAT_WEAK).
+         */
+        Word format() const {
+            return highNibble() & ODD_MASK;
+        }
+
+        void format(Word newFormat) {
+            pointer()->size = (pointer()->size & ~(static_cast<uint32_t>(ODD_MASK) << FLAGS_SHIFT)) |
+                              static_cast<uint32_t>(newFormat << FLAGS_SHIFT);
         }
 
         explicit ObjectPointer(Word data) noexcept : data(data) {};
+
+        /**
+         * Returns the heap index (in words) of the header of the referenced object.
+         */
+        inline Word index() const noexcept {
+            return data >> 2;
+        }
+
+        /**
+         * Creates a properly tagged pointer for the object which header is stored at the given heap index.
+         * Buffers are recognized by their "odd" nibble, which makeBuffer always fills with a value of 1..8.
+         */
+        static ObjectPointer forHeaderAt(Word index) noexcept {
+            Word odd = (reinterpret_cast<Object*>(baseAddress + index)->size >> FLAGS_SHIFT) & ODD_MASK;
+            return ObjectPointer((index << 2) | (odd != FORMAT_POINTERS && (odd < FORMAT_WEAK || odd >= FORMAT_EXTERNAL)
+                                                 ? BUFFER : OBJECT));
+        }
+
+        inline ExternalBytes* external() const {
+            return reinterpret_cast<ExternalBytes*>(&buffer()->fields[0]);
+        }
+
+        friend class MemoryManager;
+
     public:
 
-        //TODO make friend of MemoryManager
         static Word* baseAddress;
 
+        /**
+         * Contains the number of words occupied by the header of each object.
+         */
+        static constexpr Word HEADER_SIZE = sizeof(uint64_t) / sizeof(Word);
+
+        /**
+         * Maps the class index stored in each object header to its type. Types are registered lazily once they are
+         * first used and then remember their index in TYPE_FIELD_CLASS_INDEX. Index 0 is reserved for objects
+         * without a type. The table is maintained by the MemoryManager, which treats all its entries as roots.
+         */
+        static std::vector<ObjectPointer> classTable;
+
+        /**
+         * Contains the field of a type which stores its index in the classTable (see System::TYPE_FIELD_CLASS_INDEX).
+         */
+        static constexpr SmallInteger TYPE_FIELD_CLASS_INDEX = 7;
+
+        /**
+         * Contains one byte per card (CARD_SIZE words) of the heap. This is maintained by the MemoryManager
+         * and marked by store and transferFieldsTo so that a scavenge only has to rescan dirty cards.
+         */
+        static uint8_t* cardTable;
+
+        static constexpr Word CARD_SHIFT = 6;
+        static constexpr Word CARD_SIZE = 1 << CARD_SHIFT;
+        static constexpr uint8_t CARD_CLEAN = 0;
+        static constexpr uint8_t CARD_DIRTY = 1;
+
+        /**
+         * Objects store their format in the nibble which is used by buffers to store their odd bytes (1..8).
+         * The fields of a weak object don't keep their values alive. An ephemeron only keeps its fields alive
+         * as long as its key (field 0) is reachable. If the GC reclaims a referenced object, these fields are
+         * set to nil.
+         */
+        static constexpr Word FORMAT_POINTERS = 0;
+        static constexpr Word FORMAT_WEAK = 9;
+        static constexpr Word FORMAT_EPHEMERON = 10;
+
+        /**
+         * An external buffer is a buffer which bytes are kept outside of the heap. Therefore these are never moved
+         * or scanned by the GC and can directly be handed to I/O calls. The memory is released by the MemoryManager
+         * once the buffer itself is collected.
+         */
+        static constexpr Word FORMAT_EXTERNAL = 11;
+
+        /**
+         * Marks the remains of a dead object which the GC left in place, so that the heap can still be walked object
+         * by object. A filler is a buffer without a type.
+         */
+        static constexpr Word FORMAT_FILLER = 12;
+
+        static constexpr Word EXTERNAL_BUFFER_SIZE = sizeof(ExternalBytes) / sizeof(Word);
+
+        /**
+         * Collects the previous values of all overwritten fields while the MemoryManager performs incremental
+         * marking (snapshot at the beginning). This is null if no marking is in progress.
+         */
+        static std::vector<ObjectPointer>* markingLog;
+
         ObjectPointer() noexcept : data(0) {}
 
         ObjectPointer(const ObjectPointer& other) noexcept = default;
@@ -113,42 +225,69 @@ namespace pimii {
             return ObjectPointer(((Word) (floatValue) << 2) | ObjectPointerType::DECIMAL);
         }
 
-        ObjectPointer(Word objectIndex, ObjectPointer type, SmallInteger numberOfFields) noexcept : data(
+        ObjectPointer(Word objectIndex, ObjectPointer type, SmallInteger numberOfFields) : data(
                 (objectIndex << 2) | OBJECT) {
-            pointer()->size = static_cast<Word>(numberOfFields);
+            pointer()->size = static_cast<uint32_t>(numberOfFields);
             assert(size() == numberOfFields);
-            pointer()->type = reinterpret_cast<Word&>(type);
+            pointer()->classIndex = classIndexOf(type);
         };
 
-        ObjectPointer(Word objectIndex, ObjectPointer type, SmallInteger wordSize, SmallInteger odd) noexcept : data(
+        ObjectPointer(Word objectIndex, ObjectPointer type, SmallInteger wordSize, SmallInteger odd) : data(
                 (objectIndex << 2) | BUFFER) {
-            pointer()->size = (Word) wordSize | (Word) ((odd & ODD_MASK) << (usableSizeBytes() * 8));
-            pointer()->type = reinterpret_cast<Word&>(type);
+            pointer()->size = static_cast<uint32_t>(wordSize) | static_cast<uint32_t>((odd & ODD_MASK) << FLAGS_SHIFT);
+            pointer()->classIndex = classIndexOf(type);
         };
 
+        /**
+         * Returns the index of the given type in the classTable. If the type isn't registered yet, this is done now.
+         */
+        static uint32_t classIndexOf(ObjectPointer type) {
+            if (type.data == 0) {
+                return 0;
+            }
+
+            ObjectPointer& index = type[TYPE_FIELD_CLASS_INDEX];
+            if (index.isSmallInt()) {
+                return static_cast<uint32_t>(index.smallInt());
+            }
+
+            if (classTable.size() > CLASS_INDEX_MASK) {
+                throw std::runtime_error("Too many classes! At most " + std::to_string(CLASS_INDEX_MASK) +
+                                         " are supported (see CLASS_INDEX_BITS).");
+            }
+
+            index = forSmallInt(static_cast<SmallInteger>(classTable.size()));
+            classTable.push_back(type);
+            return static_cast<uint32_t>(classTable.size() - 1);
+        }
+
+        uint32_t classIndex() const {
+            return pointer()->classIndex & CLASS_INDEX_MASK;
+        }
+
         ObjectPointer type() const {
-            return *reinterpret_cast<ObjectPointer*>(&pointer()->type);
+            return classTable[classIndex()];
         }
 
         void type(ObjectPointer newType) {
-            pointer()->type = *reinterpret_cast<Word*>(&newType);
+            pointer()->classIndex = (pointer()->classIndex & ~CLASS_INDEX_MASK) | classIndexOf(newType);
         }
 
         ObjectPointer gcSuccessor() const {
-            return type();
+            return ObjectPointer((static_cast<Word>(pointer()->classIndex) << 2) | (data & TYPE_MASK));
         }
 
         void gcSuccessor(ObjectPointer successor) {
-            type(successor);
+            pointer()->classIndex = static_cast<uint32_t>(successor.index());
         }
 
         char gcInfo() const {
-            return (char) ((pointer()->size >> (usableSizeBytes() * 8)) & GC_MASK) >> 4;
+            return (char) (((pointer()->size >> FLAGS_SHIFT) & GC_MASK) >> 4);
         }
 
         void gcInfo(char info) {
-            pointer()->size &= clearGCMask();
-            pointer()->size |= (static_cast<Word> ((info << 4) & GC_MASK)) << (usableSizeBytes() * 8);
+            pointer()->size &= ~(static_cast<uint32_t>(GC_MASK) << FLAGS_SHIFT);
+            pointer()->size |= static_cast<uint32_t>((info << 4) & GC_MASK) << FLAGS_SHIFT;
         }
 
         bool isSmallInt() const noexcept {
@@ -160,7 +299,8 @@ namespace pimii {
                 throw std::bad_cast();
             }
 
-            return static_cast<SmallInteger>(data >> 2);
+            // Use an arithmetic shift, so that the sign is preserved if a Word only has 32 bits...
+            return static_cast<SmallInteger>(static_cast<std::make_signed_t<Word>>(data) >> 2);
         }
 
         inline bool isDecimal() const noexcept {
@@ -184,42 +324,78 @@ namespace pimii {
         }
 
         inline ObjectPointer& operator[](SmallInteger index) const {
-            if (index < 0 || index > size()) {
+            if (index < 0 || index >= size()) {
                 throw std::range_error("Index out of range.");
             }
-            return *reinterpret_cast<ObjectPointer*>(&object()->fields[index]);
+
+            // The marker doesn't trace weak fields, therefore a value which is read from one has to be recorded,
+            // as it might be stored in an object which has already been marked...
+            ObjectPointer& field = *reinterpret_cast<ObjectPointer*>(&object()->fields[index]);
+            if (markingLog != nullptr && format() >= FORMAT_WEAK && (field.isObject() || field.isBuffer())) {
+                markingLog->push_back(field);
+            }
+
+            return field;
+        }
+
+        inline bool isWeak() const {
+            return isObject() && format() >= FORMAT_WEAK;
+        }
+
+        /**
+         * Stores a value in the given field of an existing object while recording the store in the card table
+         * (and the previous value in the markingLog if required).
+         * Freshly allocated objects can be initialized via operator[] - all other stores have to use this.
+         */
+        inline void store(SmallInteger fieldIndex, ObjectPointer value) {
+            ObjectPointer& field = (*this)[fieldIndex];
+            if (markingLog != nullptr && (field.isObject() || field.isBuffer())) {
+                markingLog->push_back(field);
+            }
+            field = value;
+            if (value.isObject() || value.isBuffer()) {
+                cardTable[(index() + HEADER_SIZE + fieldIndex) >> CARD_SHIFT] = CARD_DIRTY;
+            }
         }
 
         inline bool isBuffer() const noexcept {
             return getObjectPointerType() == BUFFER;
         }
 
+        inline bool isExternal() const {
+            return isBuffer() && format() == FORMAT_EXTERNAL;
+        }
+
+        inline bool isFiller() const {
+            return isBuffer() && format() == FORMAT_FILLER;
+        }
+
         inline char fetchByte(SmallInteger index) {
             if (index < 0 || index >= byteSize()) {
                 throw std::range_error("Byte index out of range.");
             }
-            return *(reinterpret_cast<char*>(&buffer()->fields[0]) + index);
+            return *(byteArray() + index);
         }
 
         inline void storeByte(SmallInteger index, char byte) {
             if (index < 0 || index >= byteSize()) {
                 throw std::range_error("Byte index out of range.");
             }
-            *(reinterpret_cast<char*>(&buffer()->fields[0]) + index) = byte;
+            *(byteArray() + index) = byte;
         }
 
         void loadFrom(const void* src, SmallInteger byteLength) {
             if (byteLength > byteSize()) {
                 throw std::range_error("byteLength index out of range.");
             }
-            std::memcpy(&(buffer())->fields[0], src, static_cast<size_t>(byteLength));
+            std::memcpy(byteArray(), src, static_cast<size_t>(byteLength));
         }
 
         void storeTo(void* dest, SmallInteger byteLength) {
             if (byteLength > byteSize()) {
                 throw std::range_error("byteLength index out of range.");
             }
-            std::memcpy(dest, &buffer()->fields[0], static_cast<size_t>(byteLength));
+            std::memcpy(dest, byteArray(), static_cast<size_t>(byteLength));
         }
 
         void transferBytesTo(SmallInteger start, ObjectPointer dest, SmallInteger destStart, SmallInteger byteLength) {
@@ -227,9 +403,7 @@ namespace pimii {
                 byteLength > dest.byteSize() - destStart) {
                 throw std::range_error("byteLength index out of range.");
             }
-            std::memcpy(reinterpret_cast<char*>(&dest.buffer()->fields[0]) + destStart,
-                        reinterpret_cast<char*>( &buffer()->fields[0]) + start,
-                        static_cast<size_t>(byteLength));
+            std::memcpy(dest.byteArray() + destStart, byteArray() + start, static_cast<size_t>(byteLength));
         }
 
         void
@@ -238,14 +412,39 @@ namespace pimii {
                 numberOfFields > dest.size() - destStart) {
                 throw std::range_error("numberOfFields index out of range.");
             }
+            if (markingLog != nullptr) {
+                for (SmallInteger i = 0; i < numberOfFields; i++) {
+                    ObjectPointer field = dest[destStart + i];
+                    if (field.isObject() || field.isBuffer()) {
+                        markingLog->push_back(field);
+                    }
+                    ObjectPointer value = *reinterpret_cast<ObjectPointer*>(&object()->fields[start + i]);
+                    if (isWeak() && (value.isObject() || value.isBuffer())) {
+                        markingLog->push_back(value);
+                    }
+                }
+            }
             std::memcpy(&dest.object()->fields[destStart], &object()->fields[start], numberOfFields * sizeof(Word));
+
+            Word firstField = dest.index() + HEADER_SIZE + destStart;
+            for (Word card = firstField >> CARD_SHIFT; card <= (firstField + numberOfFields) >> CARD_SHIFT; card++) {
+                cardTable[card] = CARD_DIRTY;
+            }
         }
 
         std::string_view stringView() const {
+            if (isExternal()) {
+                return std::string_view(external()->bytes, external()->length);
+            }
+
             return std::string_view(byteArray());
         }
 
         char* byteArray() const {
+            if (isExternal()) {
+                return external()->bytes;
+            }
+
             return reinterpret_cast<char*>(&buffer()->fields[0]);
         }
 
@@ -277,7 +476,7 @@ namespace pimii {
                 return -1;
             }
 
-            return memcmp(&buffer()->fields[0], other, static_cast<size_t>(thisSize));
+            return memcmp(byteArray(), other, static_cast<size_t>(thisSize));
         }
 
         int compareTo(ObjectPointer other) const {
@@ -289,16 +488,19 @@ namespace pimii {
                 return -1;
             }
 
-            return memcmp(&buffer()->fields[0], &other.buffer()->fields[0], static_cast<size_t>(thisSize));
+            return memcmp(byteArray(), other.byteArray(), static_cast<size_t>(thisSize));
         }
 
         SmallInteger size() const {
-            return static_cast<SmallInteger>(pointer()->size & sizeMask());
+            return static_cast<SmallInteger>(pointer()->size & SIZE_MASK);
         }
 
         SmallInteger byteSize() const {
-            Word wordSize = buffer()->size & sizeMask();
+            Word wordSize = buffer()->size & SIZE_MASK;
             Word odd = highNibble() & ODD_MASK;
+            if (odd == FORMAT_EXTERNAL) {
+                return static_cast<SmallInteger>(external()->length);
+            }
 
             return static_cast<SmallInteger>((wordSize * sizeof(Word)) - odd);
         }
@@ -318,8 +520,28 @@ namespace pimii {
             return data != rhs.data;
         }
 
+        /**
+         * Returns the identity hash of this object. For heap objects, this is assigned lazily and kept in the upper
+         * bits of the class header, therefore it remains stable when the object is moved by the GC.
+         */
         inline SmallInteger id() const noexcept {
-            return SmallIntegers::toSafeSmallInteger(data);
+            if ((!isObject() && !isBuffer()) || data == 0) {
+                return SmallIntegers::toSafeSmallInteger(data);
+            }
+
+            uint32_t hash = pointer()->classIndex & HASH_MASK;
+            if (hash == 0) {
+                // Use a simple xorshift generator and skip values which would yield a hash of 0...
+                do {
+                    lastHash ^= lastHash << 13;
+                    lastHash ^= lastHash >> 17;
+                    lastHash ^= lastHash << 5;
+                    hash = lastHash & HASH_MASK;
+                } while (hash == 0);
+                pointer()->classIndex |= hash;
+            }
+
+            return static_cast<SmallInteger>(hash >> CLASS_INDEX_BITS);
         }
 
     };
@@ -3,25 +3,34 @@
 
 #include <cstdint>
 #include <limits>
+#include <stdexcept>
 
 namespace pimii {
 
+#ifdef PIMII_COMPRESSED_OOPS
+    // Each field (and therefore each ObjectPointer) only occupies 32 bits. As the lower two bits are used as tag,
+    // this limits the heap to 2^30 words (4 GB) and small integers to 30 bits.
+    using Word = uint32_t;
+#else
     using Word = uint64_t;
+#endif
     using SmallInteger = int32_t;
     using Decimal = float;
 
     class SmallIntegers {
+        static constexpr int TAG_BITS = sizeof(Word) < sizeof(int64_t) ? 2 : 0;
+
     public:
         static constexpr SmallInteger minSmallInt() {
-            return std::numeric_limits<int32_t>::min();
+            return std::numeric_limits<int32_t>::min() >> TAG_BITS;
         }
 
         static constexpr SmallInteger maxSmallInt() {
-            return std::numeric_limits<int32_t>::max();
+            return std::numeric_limits<int32_t>::max() >> TAG_BITS;
         }
 
         static SmallInteger toSmallInteger(int64_t value) {
-            if (value > maxSmallInt()) {
+            if (value > maxSmallInt() || value < minSmallInt()) {
                 throw std::range_error("No valid small integer!");
             }
 
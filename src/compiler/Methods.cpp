@@ -8,16 +8,21 @@
 
 namespace pimii {
 
+    AllocationSite Methods::tableSite;
+    AllocationSite Methods::methodSite;
+    SmallInteger Methods::tableVersion = 0;
+
     Methods::Methods(MemoryManager& mm, System& sys) : mm(mm), sys(sys) {
     }
 
     void Methods::addMethod(ObjectPointer type, ObjectPointer selector,
                             ObjectPointer compiledMethod) {
+        tableVersion++;
         if (type[System::TYPE_FIELD_SELECTORS] == Nil::NIL) {
-            type[System::TYPE_FIELD_SELECTORS] = ObjectPointer(
-                    mm.makeObject(8, sys.typeArray()));
-            type[System::TYPE_FIELD_METHODS] = ObjectPointer(
-                    mm.makeObject(8, sys.typeArray()));
+            type.store(System::TYPE_FIELD_SELECTORS, ObjectPointer(
+                    mm.makeObject(8, sys.typeArray(), &tableSite)));
+            type.store(System::TYPE_FIELD_METHODS, ObjectPointer(
+                    mm.makeObject(8, sys.typeArray(), &tableSite)));
             type[System::TYPE_FIELD_TALLY] = 0;
         }
 
@@ -27,13 +32,13 @@ namespace pimii {
 
         for (Looping loop = Looping(selectors.size(), selector.id()); loop.hasNext(); loop.next()) {
             if (selectors[loop()] == selector) {
-                methods[loop()] = compiledMethod;
+                methods.store(loop(), compiledMethod);
                 return;
             }
 
             if (selectors[loop()] == Nil::NIL) {
-                selectors[loop()] = selector;
-                methods[loop()] = compiledMethod;
+                selectors.store(loop(), selector);
+                methods.store(loop(), compiledMethod);
                 SmallInteger newSize = type[System::TYPE_FIELD_TALLY].smallInt() + 1;
                 if (newSize > selectors.size() * 0.75) {
                     grow(type, selectors, methods);
@@ -49,10 +54,10 @@ namespace pimii {
     }
 
     void Methods::grow(ObjectPointer type, ObjectPointer selectors, ObjectPointer methods) {
-        type[System::TYPE_FIELD_SELECTORS] =
-                mm.makeObject(selectors.size() + 8, sys.typeArray());
-        type[System::TYPE_FIELD_METHODS] =
-                mm.makeObject(selectors.size() + 8, sys.typeArray());
+        type.store(System::TYPE_FIELD_SELECTORS,
+                   mm.makeObject(selectors.size() + 8, sys.typeArray(), &tableSite));
+        type.store(System::TYPE_FIELD_METHODS,
+                   mm.makeObject(selectors.size() + 8, sys.typeArray(), &tableSite));
         type[System::TYPE_FIELD_TALLY] = 0;
         for (SmallInteger i = 0; i < selectors.size(); i++) {
             if (selectors[i] != Nil::NIL) {
@@ -66,7 +71,7 @@ namespace pimii {
                                         const std::vector<ObjectPointer>& literals,
                                         const std::vector<uint8_t>& byteCodes) {
         auto method = mm.makeObject(System::COMPILED_METHOD_SIZE + (SmallInteger) literals.size(),
-                                    sys.typeCompiledMethod());
+                                    sys.typeCompiledMethod(), &methodSite);
         method[System::COMPILED_METHOD_FIELD_HEADER] = header.value();
         method[System::COMPILED_METHOD_FIELD_OWNER] = type;
         method[System::COMPILED_METHOD_FIELD_SELECTOR] = selector;
@@ -77,7 +82,7 @@ namespace pimii {
         }
 
         if (!byteCodes.empty()) {
-            auto bytes = mm.makeBuffer((SmallInteger) byteCodes.size(), sys.typeByteArray());
+            auto bytes = mm.makeBuffer((SmallInteger) byteCodes.size(), sys.typeByteArray(), &methodSite);
             method[System::COMPILED_METHOD_FIELD_OPCODES] = bytes;
             bytes.loadFrom(byteCodes.data(), byteCodes.size());
         }
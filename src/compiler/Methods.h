@@ -64,6 +64,15 @@ namespace pimii {
         MemoryManager& mm;
         System& sys;
 
+        /**
+         * Method tables and compiled methods are commonly kept forever, therefore their allocation sites are
+         * tracked so that they can be pretenured.
+         */
+        static AllocationSite tableSite;
+        static AllocationSite methodSite;
+
+        static SmallInteger tableVersion;
+
         void grow(ObjectPointer type, ObjectPointer selectors, ObjectPointer methods);
 
     public:
@@ -77,6 +86,14 @@ namespace pimii {
                                    const std::vector<ObjectPointer>& literals,
                                    const std::vector<uint8_t>& byteCodes);
 
+        /**
+         * Counts the changes of all method tables, so that caches of method lookups (see
+         * Interpreter::lookupMethod) can detect that they are stale.
+         */
+        static SmallInteger version() {
+            return tableVersion;
+        }
+
     };
 
 }
@@ -116,7 +116,7 @@ namespace pimii {
 
         storeFields(type, instanceFields);
         storeFields(type.type(), classFields);
-        type[System::TYPE_FIELD_SUPERTYPE] = superclass;
+        type.store(System::TYPE_FIELD_SUPERTYPE, superclass);
     }
 
     void SourceFileParser::storeFields(ObjectPointer type, std::vector<std::string> fields) {
@@ -130,7 +130,7 @@ namespace pimii {
             fieldArray[index] = system.memoryManager().makeString(fields[index],
                                                                      system.typeString());
         }
-        type[System::TYPE_FIELD_FIELD_NAMES] = fieldArray;
+        type.store(System::TYPE_FIELD_FIELD_NAMES, fieldArray);
     }
 
     void SourceFileParser::parseMethodsSection() {
@@ -5,70 +5,173 @@
 #ifndef PIMII_ALLOCATOR_H
 #define PIMII_ALLOCATOR_H
 
-#include <memory>
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+#include <vector>
 #include "Segment.h"
 #include "../common/types.h"
 
 namespace pimii {
 
+    /**
+     * Splits the old space into segments of SEGMENT_SIZE words and bump allocates within the current one. Once it is
+     * exhausted, the free segment with the lowest index is taken. The Allocator only performs the bookkeeping, the
+     * MemoryManager is responsible for committing and releasing the memory of a segment.
+     */
     class Allocator {
-        std::shared_ptr<Segment> currentSegment;
-        SmallInteger allocated;
-        SmallInteger used;
-        SmallInteger counter;
-        SmallInteger maxSegments;
+        std::vector<Segment> segments;
+        std::set<size_t> freeSegments;
+        size_t currentSegment;
+        size_t segmentLimit;
+        Word startIndex;
+        Word used;
 
-
-        Word* allocateInNewSegment(SmallInteger numberOfWords) {
-            if (allocated >= maxSegments) {
-                return nullptr;
+    public:
+        /**
+         * Contains the size of a segment in words. This matches the granularity in which memory is committed.
+         */
+        static constexpr Word SEGMENT_SIZE = (2 * 1024 * 1024) / sizeof(Word);
+
+        Allocator() : currentSegment(Segment::NONE), segmentLimit(0), startIndex(0), used(0) {}
+
+        /**
+         * Creates as many segments as fit into the given range. The start index has to be aligned to SEGMENT_SIZE.
+         */
+        void initialize(Word start, Word end) {
+            startIndex = start;
+            segments.clear();
+            freeSegments.clear();
+            for (Word index = start; index + SEGMENT_SIZE <= end; index += SEGMENT_SIZE) {
+                freeSegments.insert(segments.size());
+                segments.emplace_back(index, index + SEGMENT_SIZE);
             }
-            currentSegment = std::make_shared<Segment>(SEGMENT_SIZE, currentSegment);
-            allocated += 1;
-            used += numberOfWords;
-            counter++;
+            currentSegment = Segment::NONE;
+            segmentLimit = 0;
+            used = 0;
+        }
 
-            return currentSegment->alloc(numberOfWords);
+        /**
+         * Returns the end of the range covered by all segments.
+         */
+        Word endIndex() const {
+            return startIndex + segments.size() * SEGMENT_SIZE;
         }
 
-    public:
-        static constexpr SmallInteger SEGMENT_SIZE = 640000;
+        /**
+         * Returns one past the highest segment which has ever been taken. As the free segment with the lowest index
+         * is always taken first, all segments in use are found below this limit.
+         */
+        size_t usedSegmentLimit() const {
+            return segmentLimit;
+        }
+
+        size_t numberOfSegments() const {
+            return segments.size();
+        }
 
-        explicit Allocator(SmallInteger maxSegments) : currentSegment(nullptr), allocated(0), used(0), counter(0),
-                                                       maxSegments(maxSegments) {}
+        size_t numberOfFreeSegments() const {
+            return freeSegments.size();
+        }
 
-        SmallInteger objectCount() const {
-            return counter;
+        /**
+         * Returns the number of words occupied by objects (dead or alive) in all segments.
+         */
+        Word usedWords() const {
+            return used;
         }
 
-        SmallInteger allocatedWords() const {
-            return allocated * SEGMENT_SIZE;
+        /**
+         * Returns the number of words of all segments in use, as these are backed by memory.
+         */
+        Word committedWords() const {
+            return (segments.size() - freeSegments.size()) * SEGMENT_SIZE;
         }
 
-        SmallInteger numberOfSegments() const {
-            return allocated;
+        Segment& segment(size_t segment) {
+            return segments[segment];
         }
 
-        SmallInteger usedWords() const {
-            return used;
+        Segment& segmentOf(Word index) {
+            return segments[(index - startIndex) / SEGMENT_SIZE];
+        }
+
+        /**
+         * Returns the index of the current segment or Segment::NONE if no segment has been taken yet.
+         */
+        size_t current() const {
+            return currentSegment;
+        }
+
+        /**
+         * Allocates the given number of words within the current segment. Returns 0 if it is exhausted, so that the
+         * caller has to takeSegment.
+         */
+        Word alloc(Word numberOfWords) {
+            if (currentSegment == Segment::NONE) {
+                return 0;
+            }
+
+            Word result = segments[currentSegment].alloc(numberOfWords);
+            if (result != 0) {
+                used += numberOfWords;
+            }
+
+            return result;
         }
 
-        Word* alloc(SmallInteger numberOfWords) {
-            if (currentSegment != nullptr) {
-                Word* result = currentSegment->alloc(numberOfWords);
-                if (result != nullptr) {
-                    used += numberOfWords;
-                    counter++;
-                    return result;
-                }
+        /**
+         * Makes the free segment with the lowest index the current one. Returns nullptr if all segments are in use.
+         */
+        Segment* takeSegment() {
+            if (freeSegments.empty()) {
+                return nullptr;
+            }
+
+            size_t next = *freeSegments.begin();
+            freeSegments.erase(freeSegments.begin());
+            segments[next].take();
+            segmentLimit = std::max(segmentLimit, next + 1);
+            if (currentSegment != Segment::NONE) {
+                segments[currentSegment].successorSegment(next);
             }
+            currentSegment = next;
 
-            return allocateInNewSegment(numberOfWords);
+            return &segments[next];
         }
 
-        const std::shared_ptr<Segment>& lastSegment() {
-            return currentSegment;
+        /**
+         * Takes the given segment with the given top and successor, as recorded in an image (see
+         * MemoryManager::saveImage). Once all segments are restored, the current one has to be set via restoreCurrent.
+         */
+        void restoreSegment(size_t segment, Word top, size_t successor) {
+            if (segment >= segments.size() || top < segments[segment].startIndex() ||
+                top > segments[segment].endIndex() || (successor != Segment::NONE && successor >= segments.size())) {
+                throw std::runtime_error("Invalid or truncated image!");
+            }
+
+            freeSegments.erase(segment);
+            segments[segment].restore(top, successor);
+            segmentLimit = std::max(segmentLimit, segment + 1);
+            used += segments[segment].usedWords();
+        }
+
+        void restoreCurrent(size_t segment) {
+            if (segment != Segment::NONE && (segment >= segments.size() || !segments[segment].inUse())) {
+                throw std::runtime_error("Invalid or truncated image!");
+            }
+            currentSegment = segment;
+        }
+
+        /**
+         * Hands the given segment back to the free list. The current segment must not be released.
+         */
+        void releaseSegment(size_t segment) {
+            used -= segments[segment].usedWords();
+            segments[segment].release();
+            freeSegments.insert(segment);
         }
+
     };
 }
 
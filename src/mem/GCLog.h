@@ -0,0 +1,170 @@
+#ifndef PIMII_GCLOG_H
+#define PIMII_GCLOG_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../common/types.h"
+
+namespace pimii {
+
+    enum class CollectionKind {
+        SCAVENGE = 0,
+        FULL = 1,
+        MARKING_STEP = 2
+    };
+
+    /**
+     * Describes a single pause caused by the GC. All sizes are given in bytes.
+     */
+    struct CollectionEvent {
+        CollectionKind kind;
+        uint64_t pauseMicros;
+        uint64_t promotedBytes;
+        uint64_t reclaimedBytes;
+        uint64_t usedBytesBefore;
+        uint64_t usedBytesAfter;
+    };
+
+    /**
+     * Records all collections performed by the MemoryManager. Each event is optionally written to a log file and
+     * the pause times of the last WINDOW_SIZE collections of each kind are kept, so that their percentiles can be
+     * read via counter (see Primitives::readCounter).
+     */
+    class GCLog {
+        static constexpr size_t NUMBER_OF_KINDS = 3;
+
+        std::chrono::steady_clock::time_point startup;
+        std::ofstream log;
+        std::array<uint64_t, NUMBER_OF_KINDS> counts;
+        std::array<std::vector<uint64_t>, NUMBER_OF_KINDS> pauses;
+        uint64_t promotedBytes;
+        uint64_t reclaimedBytes;
+        uint64_t usedBytes;
+
+        static constexpr const char* KIND_NAMES[NUMBER_OF_KINDS] = {"scavenge", "full", "marking-step"};
+
+        uint64_t percentile(size_t kind, size_t percent) const {
+            if (pauses[kind].empty()) {
+                return 0;
+            }
+
+            std::vector<uint64_t> sorted = pauses[kind];
+            size_t rank = (sorted.size() - 1) * percent / 100;
+            std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+            return sorted[rank];
+        }
+
+    public:
+        /**
+         * Contains the number of recent pauses per kind which are considered for the percentiles.
+         */
+        static constexpr size_t WINDOW_SIZE = 1024;
+
+        /**
+         * For each kind of collection (see CollectionKind) four counters are provided, starting at
+         * kind * COUNTERS_PER_KIND: the number of collections, and the median, 99th percentile and maximal pause
+         * in microseconds.
+         */
+        static constexpr SmallInteger COUNTERS_PER_KIND = 4;
+        static constexpr SmallInteger COUNTER_COLLECTIONS = 0;
+        static constexpr SmallInteger COUNTER_PAUSE_P50 = 1;
+        static constexpr SmallInteger COUNTER_PAUSE_P99 = 2;
+        static constexpr SmallInteger COUNTER_PAUSE_MAX = 3;
+
+        /**
+         * Contains the total number of kilobytes promoted into the old space.
+         */
+        static constexpr SmallInteger COUNTER_PROMOTED_KB = COUNTERS_PER_KIND * NUMBER_OF_KINDS;
+
+        /**
+         * Contains the total number of kilobytes reclaimed by all collections.
+         */
+        static constexpr SmallInteger COUNTER_RECLAIMED_KB = COUNTER_PROMOTED_KB + 1;
+
+        /**
+         * Contains the number of kilobytes in use right after the last collection.
+         */
+        static constexpr SmallInteger COUNTER_USED_KB = COUNTER_RECLAIMED_KB + 1;
+
+        static constexpr SmallInteger NUMBER_OF_COUNTERS = COUNTER_USED_KB + 1;
+
+        GCLog() : startup(std::chrono::steady_clock::now()), counts(), promotedBytes(0), reclaimedBytes(0),
+                  usedBytes(0) {}
+
+        /**
+         * Writes all upcoming events into the given file, one line per collection. Each line is flushed right away,
+         * so that the log is complete even if the VM is killed.
+         */
+        void open(const std::string& fileName) {
+            log.open(fileName, std::ios::out | std::ios::app);
+            if (!log) {
+                throw std::runtime_error("Cannot open the GC log!");
+            }
+        }
+
+        void record(const CollectionEvent& event) {
+            auto kind = static_cast<size_t>(event.kind);
+            std::vector<uint64_t>& window = pauses[kind];
+            if (window.size() < WINDOW_SIZE) {
+                window.push_back(event.pauseMicros);
+            } else {
+                window[counts[kind] % WINDOW_SIZE] = event.pauseMicros;
+            }
+            counts[kind]++;
+            promotedBytes += event.promotedBytes;
+            reclaimedBytes += event.reclaimedBytes;
+            usedBytes = event.usedBytesAfter;
+
+            if (log.is_open()) {
+                log << std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - startup).count()
+                    << "ms " << KIND_NAMES[kind]
+                    << " pause=" << event.pauseMicros << "us"
+                    << " promoted=" << event.promotedBytes
+                    << " reclaimed=" << event.reclaimedBytes
+                    << " before=" << event.usedBytesBefore
+                    << " after=" << event.usedBytesAfter << std::endl;
+            }
+        }
+
+        /**
+         * Returns the value of the given counter (see COUNTERS_PER_KIND) or 0 for an unknown one.
+         */
+        uint64_t counter(SmallInteger index) const {
+            if (index < 0 || index >= NUMBER_OF_COUNTERS) {
+                return 0;
+            }
+
+            if (index < COUNTER_PROMOTED_KB) {
+                auto kind = static_cast<size_t>(index / COUNTERS_PER_KIND);
+                switch (index % COUNTERS_PER_KIND) {
+                    case COUNTER_COLLECTIONS:
+                        return counts[kind];
+                    case COUNTER_PAUSE_P50:
+                        return percentile(kind, 50);
+                    case COUNTER_PAUSE_P99:
+                        return percentile(kind, 99);
+                    default:
+                        return pauses[kind].empty() ? 0 : *std::max_element(pauses[kind].begin(), pauses[kind].end());
+                }
+            }
+
+            switch (index) {
+                case COUNTER_PROMOTED_KB:
+                    return promotedBytes / 1024;
+                case COUNTER_RECLAIMED_KB:
+                    return reclaimedBytes / 1024;
+                default:
+                    return usedBytes / 1024;
+            }
+        }
+    };
+
+}
+
+#endif //PIMII_GCLOG_H
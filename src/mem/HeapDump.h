@@ -0,0 +1,117 @@
+#ifndef PIMII_HEAPDUMP_H
+#define PIMII_HEAPDUMP_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace pimii {
+
+    /**
+     * Defines the format of a heap dump (see MemoryManager::writeHeapDump). A dump starts with MAGIC followed by a
+     * sequence of records, each starting with its tag. All numbers are stored as unsigned LEB128 varints:
+     * <ul>
+     *     <li>TAG_CLASS: class index, length of the name, name bytes</li>
+     *     <li>TAG_ROOT: id of an object which is referenced from outside of the heap</li>
+     *     <li>TAG_OBJECT: id, class index, size in bytes, number of references, ids of all referenced objects</li>
+     *     <li>TAG_END: marks the end of the dump</li>
+     * </ul>
+     * The id of an object is its heap index. The references of weak objects are omitted, as these don't retain
+     * anything.
+     */
+    class HeapDump {
+    public:
+        static constexpr const char* MAGIC = "PIMIIHD1";
+        static constexpr size_t MAGIC_LENGTH = 8;
+
+        static constexpr uint8_t TAG_CLASS = 'C';
+        static constexpr uint8_t TAG_ROOT = 'R';
+        static constexpr uint8_t TAG_OBJECT = 'O';
+        static constexpr uint8_t TAG_END = 'E';
+    };
+
+    /**
+     * Streams the records of a heap dump into the given output stream.
+     */
+    class HeapDumpWriter {
+        std::ostream& out;
+
+    public:
+        explicit HeapDumpWriter(std::ostream& out) : out(out) {
+            out.write(HeapDump::MAGIC, HeapDump::MAGIC_LENGTH);
+        }
+
+        void tag(uint8_t tag) {
+            out.put(static_cast<char>(tag));
+        }
+
+        void number(uint64_t value) {
+            while (value >= 0x80) {
+                out.put(static_cast<char>((value & 0x7F) | 0x80));
+                value >>= 7;
+            }
+            out.put(static_cast<char>(value));
+        }
+
+        void string(std::string_view value) {
+            number(value.size());
+            out.write(value.data(), value.size());
+        }
+    };
+
+    /**
+     * Reads the records of a heap dump which has been written by a HeapDumpWriter.
+     */
+    class HeapDumpReader {
+        std::istream& in;
+
+        void expect(bool condition) {
+            if (!condition || !in) {
+                throw std::runtime_error("Invalid or truncated heap dump!");
+            }
+        }
+
+    public:
+        explicit HeapDumpReader(std::istream& in) : in(in) {
+            char magic[HeapDump::MAGIC_LENGTH];
+            in.read(magic, HeapDump::MAGIC_LENGTH);
+            expect(std::memcmp(magic, HeapDump::MAGIC, HeapDump::MAGIC_LENGTH) == 0);
+        }
+
+        uint8_t tag() {
+            int result = in.get();
+            expect(result != EOF);
+            return static_cast<uint8_t>(result);
+        }
+
+        uint64_t number() {
+            uint64_t result = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                int byte = in.get();
+                expect(byte != EOF);
+                result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0) {
+                    return result;
+                }
+            }
+
+            expect(false);
+            return 0;
+        }
+
+        std::string string() {
+            std::string result(number(), '\0');
+            in.read(result.data(), result.size());
+            expect(true);
+            return result;
+        }
+    };
+
+}
+
+#endif //PIMII_HEAPDUMP_H
@@ -0,0 +1,232 @@
+#ifndef PIMII_IMAGE_H
+#define PIMII_IMAGE_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../common/types.h"
+
+namespace pimii {
+
+    /**
+     * Defines the layout of an image file (see MemoryManager::saveImage). The first page contains the preamble
+     * (MAGIC, VERSION, the word size and the offset and length of the metadata). It is followed by the regions of the
+     * heap and its tables, each starting at a page boundary, so that these can be mapped into memory directly. The
+     * metadata is appended as a sequence of 64 bit words and describes which region is mapped where.
+     */
+    class Image {
+    public:
+        static constexpr uint64_t MAGIC = 0x31474d49494d4950; // "PIMIIMG1"
+        static constexpr uint64_t VERSION = 4;
+        static constexpr uint64_t PAGE_SIZE = 4096;
+        static constexpr size_t PREAMBLE_WORDS = 5;
+    };
+
+    /**
+     * Collects the layout of an image file: the regions are only referenced and placed at page aligned offsets,
+     * whereas the metadata is buffered. Once finish has computed the preamble, writeTo merely copies everything into
+     * a file, using nothing but pwrite. It can therefore be invoked in a freshly forked child process, as long as the
+     * referenced memory is left untouched.
+     */
+    class ImageWriter {
+        struct Region {
+            const void* data;
+            uint64_t offset;
+            uint64_t length;
+        };
+
+        std::vector<Region> regions;
+        std::vector<uint64_t> metadata;
+        uint64_t endOfRegions;
+        uint64_t preamble[Image::PREAMBLE_WORDS];
+
+        static uint64_t pageAligned(uint64_t position) {
+            return (position + Image::PAGE_SIZE - 1) / Image::PAGE_SIZE * Image::PAGE_SIZE;
+        }
+
+        static bool write(int fd, const void* data, uint64_t length, uint64_t offset) noexcept {
+            auto bytes = static_cast<const char*>(data);
+            while (length > 0) {
+                ssize_t written = pwrite(fd, bytes, length, static_cast<off_t>(offset));
+                if (written < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (written <= 0) {
+                    return false;
+                }
+                bytes += written;
+                offset += written;
+                length -= written;
+            }
+
+            return true;
+        }
+
+    public:
+        ImageWriter() : endOfRegions(Image::PAGE_SIZE), preamble{} {}
+
+        /**
+         * Records the given memory as region and returns its offset within the file.
+         */
+        uint64_t region(const void* data, uint64_t length) {
+            uint64_t offset = pageAligned(endOfRegions);
+            regions.push_back({data, offset, length});
+            endOfRegions = offset + length;
+            return offset;
+        }
+
+        void word(uint64_t value) {
+            metadata.push_back(value);
+        }
+
+        /**
+         * Appends the given bytes to the metadata, padded to full words.
+         */
+        void bytes(const void* data, uint64_t length) {
+            size_t start = metadata.size();
+            metadata.resize(start + (length + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+            std::memcpy(metadata.data() + start, data, length);
+        }
+
+        /**
+         * Completes the layout, once all regions and the metadata have been recorded.
+         */
+        void finish() {
+            uint64_t header[Image::PREAMBLE_WORDS] = {Image::MAGIC, Image::VERSION, sizeof(Word),
+                                                      pageAligned(endOfRegions), metadata.size()};
+            std::memcpy(preamble, header, sizeof(preamble));
+        }
+
+        /**
+         * Writes the finished image into the given file, which has to be empty. Returns false if a write failed. As
+         * the gaps between the regions are skipped, these are left as holes, which read as zeros.
+         */
+        bool writeTo(int fd) const noexcept {
+            for (const Region& region : regions) {
+                if (!write(fd, region.data, region.length, region.offset)) {
+                    return false;
+                }
+            }
+
+            return write(fd, metadata.data(), metadata.size() * sizeof(uint64_t), preamble[3]) &&
+                   write(fd, preamble, sizeof(preamble), 0);
+        }
+
+        /**
+         * Creates (or truncates) the given file and writes the finished image into it.
+         */
+        void writeTo(const std::string& fileName) const {
+            int fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            if (fd < 0) {
+                throw std::runtime_error("Cannot create the image!");
+            }
+
+            bool written = writeTo(fd);
+            if (close(fd) != 0 || !written) {
+                throw std::runtime_error("Cannot write the image!");
+            }
+        }
+    };
+
+    /**
+     * Reads the metadata of an image file and maps its regions into memory.
+     */
+    class ImageReader {
+        int fd;
+        uint64_t fileSize;
+        std::vector<uint64_t> metadata;
+        size_t position;
+
+        void read(void* target, uint64_t length, uint64_t offset) {
+            if (pread(fd, target, length, static_cast<off_t>(offset)) != static_cast<ssize_t>(length)) {
+                throw std::runtime_error("Invalid or truncated image!");
+            }
+        }
+
+    public:
+        explicit ImageReader(const std::string& fileName) : fd(open(fileName.c_str(), O_RDONLY)), fileSize(0),
+                                                            position(0) {
+            if (fd < 0) {
+                throw std::runtime_error("Cannot open the image!");
+            }
+
+            struct stat status{};
+            if (fstat(fd, &status) != 0) {
+                close(fd);
+                throw std::runtime_error("Cannot open the image!");
+            }
+            fileSize = static_cast<uint64_t>(status.st_size);
+
+            uint64_t preamble[Image::PREAMBLE_WORDS];
+            read(preamble, sizeof(preamble), 0);
+            if (preamble[0] != Image::MAGIC || preamble[1] != Image::VERSION || preamble[2] != sizeof(Word)) {
+                close(fd);
+                throw std::runtime_error("The image doesn't match this VM!");
+            }
+
+            metadata.resize(preamble[4]);
+            read(metadata.data(), metadata.size() * sizeof(uint64_t), preamble[3]);
+        }
+
+        ~ImageReader() {
+            // Established mappings remain valid once the file is closed...
+            close(fd);
+        }
+
+        ImageReader(const ImageReader&) = delete;
+
+        ImageReader& operator=(const ImageReader&) = delete;
+
+        uint64_t word() {
+            if (position >= metadata.size()) {
+                throw std::runtime_error("Invalid or truncated image!");
+            }
+
+            return metadata[position++];
+        }
+
+        void bytes(void* target, uint64_t length) {
+            uint64_t words = (length + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+            if (position + words > metadata.size()) {
+                throw std::runtime_error("Invalid or truncated image!");
+            }
+
+            std::memcpy(target, metadata.data() + position, length);
+            position += words;
+        }
+
+        /**
+         * Maps the region at the given offset copy-on-write to the given address. As a mapping always covers
+         * whole pages, the region is only read, if the address isn't page aligned.
+         */
+        void region(void* target, uint64_t offset, uint64_t length) {
+            if (length == 0) {
+                return;
+            }
+
+            // Mapping beyond the end of the file would only fail once the memory is accessed...
+            if (offset % Image::PAGE_SIZE != 0 || offset > fileSize || length > fileSize - offset) {
+                throw std::runtime_error("Invalid or truncated image!");
+            }
+
+            if (reinterpret_cast<uintptr_t>(target) % Image::PAGE_SIZE != 0) {
+                read(target, length, offset);
+            } else if (mmap(target, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd,
+                            static_cast<off_t>(offset)) == MAP_FAILED) {
+                throw std::runtime_error("Cannot map the image!");
+            }
+        }
+    };
+
+}
+
+#endif //PIMII_IMAGE_H
@@ -0,0 +1,75 @@
+#ifndef PIMII_MARKSTACK_H
+#define PIMII_MARKSTACK_H
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+
+#include "../common/ObjectPointer.h"
+
+namespace pimii {
+
+    /**
+     * Contains the gray objects of a single marking thread. The owning thread pushes and pops at the back, whereas
+     * other threads which ran out of work steal from the front - this way the owner works depth first and thieves
+     * take the oldest (and therefore usually largest) portions of the object graph.
+     * <p>
+     * Each entry also records the first field which still has to be scanned, so that large objects can be processed
+     * in chunks by pushing the remainder back onto the stack.
+     */
+    class MarkStack {
+    public:
+        struct Entry {
+            ObjectPointer object;
+            Word nextField;
+        };
+
+    private:
+        std::deque<Entry> objects;
+        std::mutex lock;
+        std::atomic<size_t> count;
+
+    public:
+        MarkStack() : count(0) {}
+
+        void push(ObjectPointer obj, Word nextField = 0) {
+            std::lock_guard<std::mutex> guard(lock);
+            objects.push_back({obj, nextField});
+            count.store(objects.size(), std::memory_order_relaxed);
+        }
+
+        bool pop(Entry& result) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (objects.empty()) {
+                return false;
+            }
+
+            result = objects.back();
+            objects.pop_back();
+            count.store(objects.size(), std::memory_order_relaxed);
+            return true;
+        }
+
+        bool steal(Entry& result) {
+            if (empty()) {
+                return false;
+            }
+
+            std::lock_guard<std::mutex> guard(lock);
+            if (objects.empty()) {
+                return false;
+            }
+
+            result = objects.front();
+            objects.pop_front();
+            count.store(objects.size(), std::memory_order_relaxed);
+            return true;
+        }
+
+        bool empty() const {
+            return count.load(std::memory_order_relaxed) == 0;
+        }
+    };
+}
+
+#endif //PIMII_MARKSTACK_H
@@ -3,9 +3,14 @@
 //
 
 #include <deque>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <map>
+#include <memory>
+#include <algorithm>
+#include <thread>
+#include <sys/mman.h>
 
 #include "MemoryManager.h"
 
@@ -14,45 +19,386 @@ namespace pimii {
     Word* MemoryManager::basePointer;
     Word MemoryManager::rootAllocationIndex;
     Word MemoryManager::rootEndIndex;
-    Word MemoryManager::allocationIndex;
+    Word MemoryManager::nurseryStartIndex;
+    Word MemoryManager::nurseryAllocationIndex;
+    Word MemoryManager::nurseryGCIndex;
+    Word MemoryManager::nurseryEndIndex;
+    Word MemoryManager::nurseryZeroedIndex;
+    Zeroer MemoryManager::nurseryZeroer;
+    Word MemoryManager::oldSpaceStartIndex;
+    Word MemoryManager::oldSpaceEndIndex;
+    Allocator MemoryManager::oldSpace;
+    Word MemoryManager::oldSpaceGCWords;
     Word MemoryManager::endIndex;
     Word MemoryManager::size;
+    std::vector<ObjectPointer*> MemoryManager::roots;
+    HugePages MemoryManager::hugePages;
+    uint8_t* MemoryManager::cards;
+    Word* MemoryManager::crossingObjects;
+    bool MemoryManager::markingActive;
+    bool MemoryManager::markingComplete;
+    Word MemoryManager::markingStartWords;
+    Word MemoryManager::nextMarkingStepIndex;
+    SmallInteger MemoryManager::markingStepMicros = 500;
+    MarkStack MemoryManager::grayObjects;
+    std::vector<ObjectPointer> MemoryManager::markingLog;
+    Word MemoryManager::largeObjectStartIndex;
+    Word MemoryManager::largeObjectAllocationIndex;
+    Word MemoryManager::largeObjectEndIndex;
+    Word MemoryManager::largeObjectWords;
+    Word MemoryManager::largeObjectGCWords;
+    std::vector<Word> MemoryManager::largeObjects;
+    std::map<Word, Word> MemoryManager::freeLargeObjectRanges;
+    std::mutex MemoryManager::referenceLock;
+    std::vector<ObjectPointer> MemoryManager::weakObjects;
+    std::vector<ObjectPointer> MemoryManager::ephemerons;
+    bool MemoryManager::weakReferencesCleared;
+    std::vector<ObjectPointer> MemoryManager::finalizationRegistry;
+    std::deque<ObjectPointer> MemoryManager::finalizationQueue;
+    bool MemoryManager::finalizersQueued;
+    std::vector<ObjectPointer> MemoryManager::externalBuffers;
+    std::deque<std::vector<SendSite>> MemoryManager::sendSiteTables;
+    std::vector<std::pair<Word, AllocationSite*>> MemoryManager::sampledAllocations;
+    Word MemoryManager::softLimitWords;
+    Word MemoryManager::hardLimitWords;
+    bool MemoryManager::lowSpaceArmed;
+    bool MemoryManager::lowSpaceRequested;
+    bool MemoryManager::lowSpaceDetected;
+    int64_t MemoryManager::wordsUntilProfiled = INT64_MAX;
+    Word MemoryManager::profilingIntervalWords;
+    std::function<void(ObjectPointer, Word)> MemoryManager::allocationProfiler;
+    GCLog MemoryManager::gcLog;
+    Word MemoryManager::lastPromotedWords;
+    std::vector<ObjectPointer> MemoryManager::imageRootObjects;
     Word* ObjectPointer::baseAddress;
+    uint8_t* ObjectPointer::cardTable;
+    std::vector<ObjectPointer>* ObjectPointer::markingLog;
+    std::vector<ObjectPointer> ObjectPointer::classTable;
+    uint32_t ObjectPointer::lastHash = 2463534242;
 
 
-    void MemoryManager::initialize(std::string imageFileName) {
-        /*
-        std::ifstream infile(imageFileName);
-        bool keepReading = true;
-        std::string line;
-        std::map<std::string, Word> metas;
-        while (keepReading && std::getline(infile, line)) {
-            if (line == "image:") {
-                keepReading = false;
-            } else {
-                size_t split_pos;
-                if ((split_pos = line.find (':', 0)) != std::string::npos) {
-                    metas[line.substr(0,split_pos)] = std::atol(line.substr(split_pos).c_str());
-                }
-            }
+    void MemoryManager::initialize(std::string imageFileName, Word maximumHeapSize, HugePages pageMode) {
+        // The layout of the heap is determined by its size, therefore an image dictates the size...
+        std::unique_ptr<ImageReader> image;
+        if (!imageFileName.empty()) {
+            image = std::make_unique<ImageReader>(imageFileName);
+            maximumHeapSize = image->word();
         }
 
-        basePointer = static_cast<Word*>(calloc(metas["heap_size"], sizeof(Word)));
-        memset(basePointer, 0, metas["heap_size"] * sizeof(Word));
-        size = metas["heap_size"];
-        rootAllocationIndex = 1;
-        rootEndIndex = metas["root_end_index"];
-        allocationIndex = rootEndIndex;
-        endIndex = size;
-*/
-        basePointer = static_cast<Word*>(calloc(16000000, sizeof(Word)));
-        memset(basePointer, 0, 16000000 * sizeof(Word));
-        size = 16000000;
+        size = maximumHeapSize;
+        hugePages = pageMode;
+
         rootAllocationIndex = 1;
-        rootEndIndex = 2048;
-        allocationIndex = rootEndIndex;
+        rootEndIndex = image != nullptr ? image->word() : 2048;
+        nurseryStartIndex = rootEndIndex;
+        nurseryAllocationIndex = nurseryStartIndex;
+        nurseryEndIndex = nurseryStartIndex + NURSERY_SIZE;
+        nurseryZeroedIndex = nurseryEndIndex;
+        nurseryGCIndex = nurseryStartIndex + NURSERY_SIZE / 4 * 3;
+        // The old space starts at a segment boundary, so that each segment can be backed by a huge page...
+        oldSpaceStartIndex = (nurseryEndIndex + Allocator::SEGMENT_SIZE - 1) / Allocator::SEGMENT_SIZE *
+                             Allocator::SEGMENT_SIZE;
         endIndex = size;
+        if (endIndex < oldSpaceStartIndex + MINIMAL_OLD_SPACE_GROWTH) {
+            throw std::runtime_error("The maximal heap size is too small!");
+        }
+
+        // An ObjectPointer stores the index of its object shifted by two bits and a GC stores the new index of an
+        // object in its 32 bit class header, therefore the address range of the heap is limited...
+        Word addressableWords = std::min(~static_cast<Word>(0) >> 2, static_cast<Word>(UINT32_MAX));
+        if (size > addressableWords - LARGE_OBJECT_SPACE_SIZE - 2 * COMMIT_WORDS) {
+            throw std::runtime_error("The maximal heap size exceeds the addressable range!");
+        }
+
+        // The whole heap is only reserved as address space and committed on demand. The large object space is
+        // reserved directly above the heap so that its objects can still be addressed relative to the base
+        // address. We reserve an additional chunk so that the heap can be aligned for explicit huge pages...
+        largeObjectStartIndex = (size + COMMIT_WORDS - 1) / COMMIT_WORDS * COMMIT_WORDS;
+        largeObjectAllocationIndex = largeObjectStartIndex;
+        largeObjectEndIndex = largeObjectStartIndex + LARGE_OBJECT_SPACE_SIZE;
+        basePointer = static_cast<Word*>(reserve((largeObjectEndIndex + COMMIT_WORDS) * sizeof(Word)));
+        basePointer += (COMMIT_WORDS - (reinterpret_cast<uintptr_t>(basePointer) / sizeof(Word)) % COMMIT_WORDS) %
+                       COMMIT_WORDS;
+        commit(0, oldSpaceStartIndex);
+
+        oldSpace.initialize(oldSpaceStartIndex, endIndex);
+        oldSpaceEndIndex = oldSpace.endIndex();
+        if (image == nullptr) {
+            takeSegment();
+        }
+
+        oldSpaceGCWords = MINIMAL_OLD_SPACE_GROWTH;
+        markingStartWords = MINIMAL_OLD_SPACE_GROWTH / 2;
+        nextMarkingStepIndex = NO_MARKING_STEP;
         ObjectPointer::baseAddress = basePointer;
+
+        largeObjectWords = 0;
+        largeObjectGCWords = LARGE_OBJECT_SPACE_SIZE / 2;
+
+        softLimitWords = size / 4 * 3;
+        hardLimitWords = NO_HEAP_LIMIT;
+        lowSpaceArmed = true;
+        lowSpaceRequested = false;
+
+        // Just like the heap, these tables are only backed by memory where they are actually used...
+        cards = static_cast<uint8_t*>(reserve((largeObjectEndIndex >> ObjectPointer::CARD_SHIFT) + 1,
+                                              PROT_READ | PROT_WRITE));
+        crossingObjects = static_cast<Word*>(reserve(((size >> ObjectPointer::CARD_SHIFT) + 1) * sizeof(Word),
+                                                     PROT_READ | PROT_WRITE));
+        ObjectPointer::cardTable = cards;
+        ObjectPointer::classTable.assign(1, Nil::NIL);
+
+        if (image != nullptr) {
+            restoreImage(*image);
+        }
+    }
+
+    void MemoryManager::saveImage(const std::string& fileName, const std::vector<ObjectPointer>& imageRoots) {
+        ImageWriter image;
+        prepareImage(image, imageRoots);
+        image.writeTo(fileName);
+    }
+
+    pid_t MemoryManager::forkImageWriter(const std::string& fileName, const std::vector<ObjectPointer>& imageRoots) {
+        // Everything the child needs is computed up front, as after fork it may only use async-signal-safe calls...
+        ImageWriter image;
+        prepareImage(image, imageRoots);
+        const char* file = fileName.c_str();
+
+        nurseryZeroer.pause();
+        pid_t pid = fork();
+        if (pid == 0) {
+            int fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            bool written = fd >= 0 && image.writeTo(fd);
+            _exit(fd >= 0 && close(fd) == 0 && written ? 0 : 1);
+        }
+        nurseryZeroer.resume();
+
+        return pid;
+    }
+
+    void MemoryManager::prepareImage(ImageWriter& image, const std::vector<ObjectPointer>& imageRoots) {
+        if (markingActive) {
+            throw std::runtime_error("Cannot save an image while marking!");
+        }
+
+        image.word(size);
+        image.word(rootEndIndex);
+        image.word(rootAllocationIndex);
+        image.word(nurseryAllocationIndex);
+        image.word(ObjectPointer::lastHash);
+
+        // The root region is directly followed by the nursery, therefore both are stored as one region...
+        image.word(image.region(basePointer, nurseryAllocationIndex * sizeof(Word)));
+
+        size_t segmentLimit = oldSpace.usedSegmentLimit();
+        std::vector<size_t> segmentsInUse;
+        for (size_t index = 0; index < segmentLimit; index++) {
+            if (oldSpace.segment(index).inUse()) {
+                segmentsInUse.push_back(index);
+            }
+        }
+        image.word(segmentLimit);
+        image.word(segmentsInUse.size());
+        for (size_t index : segmentsInUse) {
+            Segment& segment = oldSpace.segment(index);
+            image.word(index);
+            image.word(segment.topIndex());
+            image.word(segment.successorSegment());
+            image.word(image.region(basePointer + segment.startIndex(), segment.usedWords() * sizeof(Word)));
+        }
+        image.word(oldSpace.current());
+
+        // The cards are stored, as the nursery might still be referenced from the old space...
+        Word firstCard = oldSpaceStartIndex >> ObjectPointer::CARD_SHIFT;
+        Word numberOfCards = (segmentLimit * Allocator::SEGMENT_SIZE) >> ObjectPointer::CARD_SHIFT;
+        image.word(image.region(cards + firstCard, numberOfCards));
+        image.word(image.region(crossingObjects + firstCard, numberOfCards * sizeof(Word)));
+
+        image.word(largeObjectAllocationIndex);
+        image.word(largeObjects.size());
+        for (Word index : largeObjects) {
+            Word pagedWords = (ObjectPointer::forHeaderAt(index).size() + HEADER_SIZE + PAGE_WORDS - 1) / PAGE_WORDS *
+                              PAGE_WORDS;
+            image.word(index);
+            image.word(pagedWords);
+            image.word(image.region(basePointer + index, pagedWords * sizeof(Word)));
+        }
+        image.word(image.region(cards + (largeObjectStartIndex >> ObjectPointer::CARD_SHIFT),
+                                (largeObjectAllocationIndex - largeObjectStartIndex) >> ObjectPointer::CARD_SHIFT));
+        image.word(freeLargeObjectRanges.size());
+        for (auto[index, numberOfWords] : freeLargeObjectRanges) {
+            image.word(index);
+            image.word(numberOfWords);
+        }
+
+        auto writeObjects = [&image](auto& objects) {
+            image.word(objects.size());
+            for (ObjectPointer obj : objects) {
+                image.word(obj.data);
+            }
+        };
+        writeObjects(ObjectPointer::classTable);
+        writeObjects(finalizationRegistry);
+        writeObjects(finalizationQueue);
+        writeObjects(imageRoots);
+
+        image.word(sendSiteTables.size());
+        for (std::vector<SendSite>& table : sendSiteTables) {
+            image.word(table.size());
+            image.bytes(table.data(), table.size() * sizeof(SendSite));
+        }
+
+        image.word(externalBuffers.size());
+        for (ObjectPointer buffer : externalBuffers) {
+            image.word(buffer.data);
+            image.word(buffer.external()->length);
+            image.bytes(buffer.external()->bytes, buffer.external()->length);
+        }
+
+        image.finish();
+    }
+
+    /**
+     * Maps the regions of the given image into the freshly reserved heap and restores all bookkeeping in the order
+     * written by saveImage.
+     */
+    void MemoryManager::restoreImage(ImageReader& image) {
+        // Each region is mapped to a fixed address, therefore everything which determines an address or a length
+        // is validated against the reserved heap first...
+        auto expect = [](bool condition) {
+            if (!condition) {
+                throw std::runtime_error("Invalid or truncated image!");
+            }
+        };
+
+        rootAllocationIndex = image.word();
+        nurseryAllocationIndex = image.word();
+        ObjectPointer::lastHash = static_cast<uint32_t>(image.word());
+        expect(rootAllocationIndex <= rootEndIndex && nurseryAllocationIndex >= nurseryStartIndex &&
+               nurseryAllocationIndex <= nurseryEndIndex);
+        image.region(basePointer, image.word(), nurseryAllocationIndex * sizeof(Word));
+
+        auto segmentLimit = static_cast<size_t>(image.word());
+        expect(segmentLimit <= oldSpace.numberOfSegments());
+        for (uint64_t count = image.word(); count > 0; count--) {
+            auto index = static_cast<size_t>(image.word());
+            expect(index < segmentLimit);
+            Word top = image.word();
+            auto successor = static_cast<size_t>(image.word());
+            oldSpace.restoreSegment(index, top, successor);
+
+            // The part of the segment above its top has to be zero filled, just like a freshly taken segment...
+            Segment& segment = oldSpace.segment(index);
+            commit(segment.startIndex(), Allocator::SEGMENT_SIZE);
+            image.region(basePointer + segment.startIndex(), image.word(), segment.usedWords() * sizeof(Word));
+        }
+        oldSpace.restoreCurrent(static_cast<size_t>(image.word()));
+
+        Word firstCard = oldSpaceStartIndex >> ObjectPointer::CARD_SHIFT;
+        Word numberOfCards = (segmentLimit * Allocator::SEGMENT_SIZE) >> ObjectPointer::CARD_SHIFT;
+        image.region(cards + firstCard, image.word(), numberOfCards);
+        image.region(crossingObjects + firstCard, image.word(), numberOfCards * sizeof(Word));
+
+        largeObjectAllocationIndex = image.word();
+        expect(largeObjectAllocationIndex >= largeObjectStartIndex && largeObjectAllocationIndex <= largeObjectEndIndex);
+        auto isLargeObjectRange = [](Word index, Word numberOfWords) {
+            return index >= largeObjectStartIndex && index < largeObjectAllocationIndex && numberOfWords > 0 &&
+                   numberOfWords <= largeObjectAllocationIndex - index;
+        };
+        for (uint64_t count = image.word(); count > 0; count--) {
+            Word index = image.word();
+            Word pagedWords = image.word();
+            expect(isLargeObjectRange(index, pagedWords) && index % PAGE_WORDS == 0);
+            image.region(basePointer + index, image.word(), pagedWords * sizeof(Word));
+            largeObjects.push_back(index);
+            largeObjectWords += pagedWords;
+        }
+        image.region(cards + (largeObjectStartIndex >> ObjectPointer::CARD_SHIFT), image.word(),
+                     (largeObjectAllocationIndex - largeObjectStartIndex) >> ObjectPointer::CARD_SHIFT);
+        for (uint64_t count = image.word(); count > 0; count--) {
+            Word index = image.word();
+            Word numberOfWords = image.word();
+            expect(isLargeObjectRange(index, numberOfWords));
+            freeLargeObjectRanges[index] = numberOfWords;
+        }
+
+        auto readObjects = [&image](auto& objects) {
+            objects.clear();
+            for (uint64_t count = image.word(); count > 0; count--) {
+                objects.push_back(ObjectPointer::forObject(image.word()));
+            }
+        };
+        readObjects(ObjectPointer::classTable);
+        readObjects(finalizationRegistry);
+        readObjects(finalizationQueue);
+        readObjects(imageRootObjects);
+
+        for (uint64_t count = image.word(); count > 0; count--) {
+            std::vector<SendSite>& table = sendSiteTables.emplace_back(image.word());
+            image.bytes(table.data(), table.size() * sizeof(SendSite));
+        }
+
+        // External buffers are re-allocated outside of the heap (see makeExternalBuffer)...
+        size_t pageSize = PAGE_WORDS * sizeof(Word);
+        for (uint64_t count = image.word(); count > 0; count--) {
+            ObjectPointer buffer = ObjectPointer::forObject(image.word());
+            uint64_t length = image.word();
+            size_t numberOfPages = std::max<size_t>(1, (length + pageSize - 1) / pageSize);
+            char* bytes = static_cast<char*>(std::aligned_alloc(pageSize, numberOfPages * pageSize));
+            if (bytes == nullptr) {
+                throw std::runtime_error("Cannot allocate an external buffer.");
+            }
+            std::memset(bytes, 0, numberOfPages * pageSize);
+            image.bytes(bytes, length);
+            buffer.external()->bytes = bytes;
+            externalBuffers.push_back(buffer);
+        }
+
+        updateCollectionThresholds();
+    }
+
+    void* MemoryManager::reserve(Word numberOfBytes, int protection) {
+        void* result = mmap(nullptr, numberOfBytes, protection, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (result == MAP_FAILED) {
+            throw std::runtime_error("Cannot reserve the heap!");
+        }
+
+        return result;
+    }
+
+    /**
+     * Makes the next free segment the one to allocate in. As a segment spans exactly one chunk of COMMIT_WORDS,
+     * explicit huge pages can be used if these are available. The memory of a free segment has been handed back
+     * to the operating system (see evacuate), therefore it is zero filled once committed again.
+     */
+    void MemoryManager::takeSegment() {
+        Segment* segment = oldSpace.takeSegment();
+        if (segment == nullptr) {
+            throw std::runtime_error("Running out of memory!");
+        }
+
+        commit(segment->startIndex(), Allocator::SEGMENT_SIZE);
+        checkSoftLimit();
+    }
+
+    void MemoryManager::setHeapLimits(Word softLimit, Word hardLimit) {
+        if (softLimit > hardLimit) {
+            throw std::runtime_error("The soft heap limit must not exceed the hard one!");
+        }
+
+        softLimitWords = softLimit;
+        hardLimitWords = hardLimit;
+    }
+
+    /**
+     * Requests a full collection once the committed heap grows beyond the soft limit. As we must not collect outside
+     * of a safepoint, this is only recorded and picked up by shouldRunRecommendedGC.
+     */
+    void MemoryManager::checkSoftLimit() {
+        if (lowSpaceArmed && heapWords() >= softLimitWords) {
+            lowSpaceRequested = true;
+        }
     }
 
     ObjectPointer MemoryManager::makeRootObject(SmallInteger numberOfFields, ObjectPointer type) {
@@ -60,9 +406,9 @@ namespace pimii {
             throw std::runtime_error("Cannot allocate negative memory.");
         }
 
-        if (rootAllocationIndex + numberOfFields + 2 < rootEndIndex) {
+        if (rootAllocationIndex + numberOfFields + HEADER_SIZE < rootEndIndex) {
             Word result = rootAllocationIndex;
-            rootAllocationIndex += numberOfFields + 2;
+            rootAllocationIndex += numberOfFields + HEADER_SIZE;
             if ((result << 2) == 324) {
                 std::cout << result << std::endl;
             }
@@ -72,129 +418,1298 @@ namespace pimii {
         }
     }
 
-    ObjectPointer MemoryManager::makeBuffer(SmallInteger numberOfBytes, ObjectPointer type) {
+    ObjectPointer MemoryManager::makeBuffer(SmallInteger numberOfBytes, ObjectPointer type, AllocationSite* site) {
+        ObjectPointer obj = allocateBuffer(numberOfBytes, type, site != nullptr && shouldPretenure(*site));
+        if (site != nullptr) {
+            sampleAllocation(obj, *site);
+        }
+
+        return obj;
+    }
+
+    ObjectPointer MemoryManager::allocateBuffer(SmallInteger numberOfBytes, ObjectPointer type, bool pretenure) {
         SmallInteger numberOfWords = numberOfBytes / sizeof(Word);
         SmallInteger odd = sizeof(Word) - (numberOfBytes % sizeof(Word));
         if (odd != 0) {
             numberOfWords++;
         }
 
-        if (allocationIndex + numberOfWords + 2 < endIndex) {
-            Word result = allocationIndex;
-            allocationIndex += numberOfWords + 2;
+        if (static_cast<Word>(numberOfWords) + HEADER_SIZE >= LARGE_OBJECT_THRESHOLD) {
+            if (static_cast<Word>(numberOfWords) > MAX_OBJECT_SIZE) {
+                throw std::runtime_error("Cannot allocate a buffer of this size.");
+            }
+
+            ObjectPointer op = {allocateLargeObject(numberOfWords + HEADER_SIZE), type, numberOfWords, odd};
+            if (markingActive) {
+                op.gcInfo(STATE_MARKED);
+            }
+            return profiled(op, numberOfWords + HEADER_SIZE);
+        }
 
-            ObjectPointer op = {result, type, numberOfWords, odd};
-            assert(op.isBuffer());
-            return op;
+        Word result;
+        if (!pretenure && nurseryAllocationIndex + numberOfWords + HEADER_SIZE < nurseryEndIndex) {
+            result = nurseryAllocationIndex;
+            nurseryAllocationIndex += numberOfWords + HEADER_SIZE;
+            if (nurseryAllocationIndex > nurseryZeroedIndex) {
+                awaitZeroedNursery(nurseryAllocationIndex);
+            }
         } else {
-            throw std::runtime_error("Running out of memory!");
+            result = allocateDirtyInOldSpace(numberOfWords + HEADER_SIZE);
         }
+
+        ObjectPointer op = {result, type, numberOfWords, odd};
+        assert(op.isBuffer());
+        return profiled(op, numberOfWords + HEADER_SIZE);
     }
 
-    ObjectPointer MemoryManager::makeString(std::string_view string, ObjectPointer type) {
+    ObjectPointer MemoryManager::makeString(std::string_view string, ObjectPointer type, AllocationSite* site) {
         auto byteLength = SmallIntegers::toSmallInteger(string.size() + 1);
-        ObjectPointer obj = makeBuffer(byteLength, type);
+        ObjectPointer obj = makeBuffer(byteLength, type, site);
         obj.loadFrom(string.data(), byteLength);
         return obj;
     }
-//
-//    void MemoryManager::gc() {
-//        std::deque<ObjectPointer> gcWork;
-//        std::unique_ptr<Allocator> garbageBuffers = std::move(buffers);
-//        std::unique_ptr<Allocator> garbageObjects = std::move(activeObjects);
-//
-//        activeObjects = std::make_unique<Allocator>(maxSegmentsPerPool);
-//        buffers = std::make_unique<Allocator>(maxSegmentsPerPool);
-//
-//        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
-//        for (auto root : rootObjects) {
-//            translateObject(root, gcWork);
-//        }
-//
-//        int objectsMoved = 0;
-//        while (!gcWork.empty()) {
-//            ObjectPointer obj = gcWork.front();
-//            gcWork.pop_front();
-//
-//            translateObject(obj, gcWork);
-//            objectsMoved++;
-//        }
-//
-//        objectsLowWaterMark =
-//                std::min(objectsHighWaterMark,
-//                         activeObjects->numberOfSegments() +
-//                         (maxSegmentsPerPool - activeObjects->numberOfSegments()) / 3);
-//        buffersLowWaterMark =
-//                std::min(buffersHighWaterMark,
-//                         activeObjects->numberOfSegments() + (maxSegmentsPerPool - buffers->allocatedWords()) / 3);
-//
-//        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-//
-//        gcDurationMicros += std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
-//        gcCounter++;
-//    }
-//
-//
-//    ObjectPointer MemoryManager::copyObject(ObjectPointer obj, std::deque<ObjectPointer>& gcWork) {
-//        obj.gcInfo(STATE_FULLY_MOVED);
-//        ObjectPointer copy = makeObject(obj.size(), obj.type());
-//        obj.transferFieldsTo(0, copy, 0, obj.size());
-//        copy.gcInfo(STATE_PARTIALLY_MOVED);
-//        obj.gcSuccessor(copy);
-//        gcWork.push_back(copy);
-//
-//        return copy;
-//    }
-//
-//    ObjectPointer MemoryManager::copyBuffer(ObjectPointer buffer, std::deque<ObjectPointer>& gcWork) {
-//        buffer.gcInfo(STATE_FULLY_MOVED);
-//        ObjectPointer copy = makeBuffer(buffer.byteSize(), translateField(buffer.type(), gcWork));
-//        buffer.transferBytesTo(0, copy, 0, buffer.byteSize());
-//        copy.gcInfo(STATE_ORIGINAL);
-//
-//        buffer.gcSuccessor(copy);
-//
-//        return copy;
-//    }
-//
-//    void MemoryManager::translateObject(ObjectPointer obj, std::deque<ObjectPointer>& gcWork) {
-//        if (obj.gcInfo() == STATE_PARTIALLY_MOVED) {
-//            obj.gcInfo(STATE_ORIGINAL);
-//        }
-//
-//        obj.type(translateField(obj.type(), gcWork));
-//        for (SmallInteger i = 0; i < obj.size(); i++) {
-//            obj[i] = translateField(obj[i], gcWork);
-//        }
-//    }
-//
-//    ObjectPointer MemoryManager::translateField(ObjectPointer field, std::deque<ObjectPointer>& gcWork) {
-//        if (field.isSmallInt() || field.isDecimal() || field == Nil::NIL) {
-//            return field;
-//        }
-//
-//        char gcInfo = field.gcInfo();
-//        if (gcInfo == STATE_ORIGINAL) {
-//            if (field.isObject()) {
-//                return copyObject(field, gcWork);
-//            } else if (field.isBuffer()) {
-//                return copyBuffer(field, gcWork);
-//            }
-//        } else if (gcInfo == STATE_PARTIALLY_MOVED || gcInfo == STATE_FULLY_MOVED) {
-//            return field.gcSuccessor();
-//        } else if (gcInfo == STATE_ROOT) {
-//            return field;
-//        }
-//
-//        throw std::bad_alloc();
-//    }
-//
-//    bool MemoryManager::shouldIdleGC() {
-//        return activeObjects->allocatedWords() > objectsLowWaterMark || buffers->allocatedWords() > buffersLowWaterMark;
-//    }
-//
-//    void MemoryManager::idleGC() {
-//       // gc();
-//    }
+
+    ObjectPointer MemoryManager::makeExternalBuffer(SmallInteger numberOfBytes, ObjectPointer type) {
+        if (numberOfBytes < 0) {
+            throw std::runtime_error("Cannot allocate negative memory.");
+        }
+
+        // aligned_alloc requires the size to be a multiple of the alignment...
+        size_t pageSize = PAGE_WORDS * sizeof(Word);
+        size_t numberOfPages = std::max<size_t>(1, (static_cast<size_t>(numberOfBytes) + pageSize - 1) / pageSize);
+        char* bytes = static_cast<char*>(std::aligned_alloc(pageSize, numberOfPages * pageSize));
+        if (bytes == nullptr) {
+            throw std::runtime_error("Cannot allocate an external buffer.");
+        }
+        std::memset(bytes, 0, numberOfPages * pageSize);
+
+        ObjectPointer obj = makeObject(ObjectPointer::EXTERNAL_BUFFER_SIZE, type);
+        obj.format(ObjectPointer::FORMAT_EXTERNAL);
+        obj = ObjectPointer::forHeaderAt(obj.index());
+        obj.external()->bytes = bytes;
+        obj.external()->length = static_cast<uint64_t>(numberOfBytes);
+        externalBuffers.push_back(obj);
+
+        return obj;
+    }
+
+    ObjectPointer MemoryManager::makeLargeObject(SmallInteger numberOfFields, ObjectPointer type) {
+        if (static_cast<Word>(numberOfFields) > MAX_OBJECT_SIZE) {
+            throw std::runtime_error("Cannot allocate an object of this size.");
+        }
+
+        ObjectPointer obj = {allocateLargeObject(numberOfFields + HEADER_SIZE), type, numberOfFields};
+        if (markingActive) {
+            obj.gcInfo(STATE_MARKED);
+        }
+
+        return profiled(obj, numberOfFields + HEADER_SIZE);
+    }
+
+    ObjectPointer MemoryManager::makeObject(SmallInteger numberOfFields, ObjectPointer type, AllocationSite* site) {
+        if (site == nullptr) {
+            return makeObject(numberOfFields, type);
+        }
+
+        if (shouldPretenure(*site)) {
+            return makeOldObject(numberOfFields, type);
+        }
+
+        ObjectPointer obj = makeObject(numberOfFields, type);
+        sampleAllocation(obj, *site);
+        return obj;
+    }
+
+    ObjectPointer MemoryManager::makeOldObject(SmallInteger numberOfFields, ObjectPointer type) {
+        if (numberOfFields < 0) {
+            throw std::runtime_error("Cannot allocate negative memory.");
+        }
+
+        if (static_cast<Word>(numberOfFields) + HEADER_SIZE >= LARGE_OBJECT_THRESHOLD) {
+            return makeLargeObject(numberOfFields, type);
+        }
+
+        return profiled({allocateDirtyInOldSpace(numberOfFields + HEADER_SIZE), type, numberOfFields},
+                        numberOfFields + HEADER_SIZE);
+    }
+
+    uint32_t MemoryManager::makeSendSiteTable(Word numberOfByteCodes) {
+        // The IP after the last send equals the number of byte codes...
+        sendSiteTables.emplace_back(numberOfByteCodes + 1, SendSite());
+        return static_cast<uint32_t>(sendSiteTables.size() - 1);
+    }
+
+    bool MemoryManager::shouldPretenure(AllocationSite& site) {
+        return site.pretenured && ++site.allocations % PRETENURING_PROBE_INTERVAL != 0;
+    }
+
+    void MemoryManager::sampleAllocation(ObjectPointer obj, AllocationSite& site) {
+        if (isYoung(obj)) {
+            sampledAllocations.emplace_back(obj.index(), &site);
+        }
+    }
+
+    /**
+     * Records which of the sampled objects survived the current scavenge. Once enough samples are collected, a
+     * site is pretenured if most of its objects survived - or no longer pretenured otherwise.
+     */
+    void MemoryManager::updateAllocationSites() {
+        for (auto [index, site] : sampledAllocations) {
+            site->samples++;
+            if (ObjectPointer::forHeaderAt(index).gcInfo() == STATE_FORWARDED) {
+                site->survivors++;
+            }
+
+            if (site->samples >= PRETENURING_SAMPLES) {
+                site->pretenured = site->survivors * 100 >= site->samples * PRETENURING_SURVIVAL_PERCENT;
+                site->samples = 0;
+                site->survivors = 0;
+            }
+        }
+
+        sampledAllocations.clear();
+    }
+
+    ObjectPointer MemoryManager::makeWeakObject(SmallInteger numberOfFields, ObjectPointer type, AllocationSite* site) {
+        ObjectPointer obj = makeObject(numberOfFields, type, site);
+        obj.format(ObjectPointer::FORMAT_WEAK);
+        return obj;
+    }
+
+    ObjectPointer MemoryManager::makeEphemeron(SmallInteger numberOfFields, ObjectPointer type) {
+        if (numberOfFields < 1) {
+            throw std::runtime_error("An ephemeron requires at least a key.");
+        }
+
+        ObjectPointer obj = makeObject(numberOfFields, type);
+        obj.format(ObjectPointer::FORMAT_EPHEMERON);
+        return obj;
+    }
+
+    void MemoryManager::registerFinalizer(ObjectPointer obj, ObjectPointer finalizer) {
+        ObjectPointer ephemeron = makeEphemeron(2, Nil::NIL);
+        ephemeron[0] = obj;
+        ephemeron[1] = finalizer;
+        finalizationRegistry.push_back(ephemeron);
+    }
+
+    ObjectPointer MemoryManager::nextFinalizer() {
+        if (finalizationQueue.empty()) {
+            return Nil::NIL;
+        }
+
+        ObjectPointer finalizer = finalizationQueue.front();
+        finalizationQueue.pop_front();
+        return finalizer;
+    }
+
+    void MemoryManager::commit(Word index, Word numberOfWords) {
+        void* address = basePointer + index;
+        size_t length = numberOfWords * sizeof(Word);
+        bool chunked = index % COMMIT_WORDS == 0 && numberOfWords % COMMIT_WORDS == 0;
+        if (hugePages == HugePages::EXPLICIT && chunked &&
+            mmap(address, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1,
+                 0) != MAP_FAILED) {
+            return;
+        }
+
+        // If no explicit huge pages are available, we fall back to regular pages...
+        if (mmap(address, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) ==
+            MAP_FAILED) {
+            throw std::runtime_error("Running out of memory!");
+        }
+
+        if (hugePages != HugePages::NONE && chunked) {
+            madvise(address, length, MADV_HUGEPAGE);
+        }
+    }
+
+    void MemoryManager::decommit(Word index, Word numberOfWords) {
+        mmap(basePointer + index, numberOfWords * sizeof(Word), PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+    }
+
+    void MemoryManager::profileAllocations(Word intervalBytes, std::function<void(ObjectPointer, Word)> profiler) {
+        profilingIntervalWords = (intervalBytes + sizeof(Word) - 1) / sizeof(Word);
+        allocationProfiler = profilingIntervalWords > 0 ? std::move(profiler) : nullptr;
+        wordsUntilProfiled = profilingIntervalWords > 0 ? static_cast<int64_t>(profilingIntervalWords) : INT64_MAX;
+    }
+
+    /**
+     * Reports the given object to the allocationProfiler. As a large object might cover several intervals, it is
+     * reported as the number of bytes of all intervals it has exhausted.
+     */
+    void MemoryManager::profileAllocation(ObjectPointer obj) {
+        if (!allocationProfiler) {
+            wordsUntilProfiled = INT64_MAX;
+            return;
+        }
+
+        Word samples = 1 + static_cast<Word>(-wordsUntilProfiled) / profilingIntervalWords;
+        wordsUntilProfiled += static_cast<int64_t>(samples * profilingIntervalWords);
+        allocationProfiler(obj, samples * profilingIntervalWords * sizeof(Word));
+    }
+
+    std::vector<ClassCensus> MemoryManager::census() {
+        std::vector<ClassCensus> result(ObjectPointer::classTable.size());
+        forEachObject([&result](Word index) {
+            ObjectPointer::Object* obj = reinterpret_cast<ObjectPointer::Object*>(basePointer + index);
+            ClassCensus& entry = result[obj->classIndex & ObjectPointer::CLASS_INDEX_MASK];
+            entry.instances++;
+            entry.bytes += ((obj->size & ObjectPointer::SIZE_MASK) + HEADER_SIZE) * sizeof(Word);
+            if ((obj->size >> ObjectPointer::FLAGS_SHIFT & ObjectPointer::ODD_MASK) == ObjectPointer::FORMAT_EXTERNAL) {
+                entry.bytes += reinterpret_cast<ObjectPointer::ExternalBytes*>(obj->fields)->length;
+            }
+        });
+
+        return result;
+    }
+
+    void MemoryManager::writeHeapDump(std::ostream& out,
+                                      const std::function<std::string_view(ObjectPointer)>& className) {
+        HeapDumpWriter writer(out);
+        for (size_t index = 1; index < ObjectPointer::classTable.size(); index++) {
+            writer.tag(HeapDump::TAG_CLASS);
+            writer.number(index);
+            writer.string(className(ObjectPointer::classTable[index]));
+        }
+
+        auto writeRoot = [&writer](ObjectPointer root) {
+            if ((root.isObject() || root.isBuffer()) && root != Nil::NIL) {
+                writer.tag(HeapDump::TAG_ROOT);
+                writer.number(root.index());
+            }
+        };
+        for (ObjectPointer* root : roots) {
+            writeRoot(*root);
+        }
+        std::for_each(ObjectPointer::classTable.begin(), ObjectPointer::classTable.end(), writeRoot);
+        std::for_each(finalizationRegistry.begin(), finalizationRegistry.end(), writeRoot);
+        std::for_each(finalizationQueue.begin(), finalizationQueue.end(), writeRoot);
+        auto writeRootAt = [&writeRoot](Word index) { writeRoot(ObjectPointer::forHeaderAt(index)); };
+        forEachObjectIn(1, rootAllocationIndex, writeRootAt);
+
+        forEachObject([&writer](Word index) {
+            ObjectPointer obj = ObjectPointer::forHeaderAt(index);
+            Word numberOfFields = static_cast<Word>(obj.size());
+            uint64_t bytes = (numberOfFields + HEADER_SIZE) * sizeof(Word);
+            if (obj.isExternal()) {
+                bytes += obj.external()->length;
+            }
+
+            writer.tag(HeapDump::TAG_OBJECT);
+            writer.number(index);
+            writer.number(obj.classIndex());
+            writer.number(bytes);
+
+            ObjectPointer* fields = reinterpret_cast<ObjectPointer*>(basePointer + index + HEADER_SIZE);
+            if (!obj.isObject() || obj.format() == ObjectPointer::FORMAT_WEAK) {
+                numberOfFields = 0;
+            }
+            auto isReference = [](ObjectPointer field) {
+                return (field.isObject() || field.isBuffer()) && field != Nil::NIL;
+            };
+            writer.number(static_cast<uint64_t>(std::count_if(fields, fields + numberOfFields, isReference)));
+            for (Word i = 0; i < numberOfFields; i++) {
+                if (isReference(fields[i])) {
+                    writer.number(fields[i].index());
+                }
+            }
+        });
+
+        writer.tag(HeapDump::TAG_END);
+        out.flush();
+    }
+
+    /**
+     * Walks the heap using one thread per core and returns all objects which match the given predicate. The heap is
+     * split into ranges which start at known object boundaries: the root region, the nursery, each segment in use
+     * and each large object. Each thread walks the next unclaimed range, so that the predicate must be thread safe.
+     */
+    template<typename P>
+    std::vector<ObjectPointer> MemoryManager::findObjects(P predicate) {
+        std::vector<std::pair<Word, Word>> ranges;
+        ranges.emplace_back(1, rootAllocationIndex);
+        ranges.emplace_back(nurseryStartIndex, nurseryAllocationIndex);
+        for (size_t index = 0; index < oldSpace.usedSegmentLimit(); index++) {
+            Segment& segment = oldSpace.segment(index);
+            if (segment.inUse()) {
+                ranges.emplace_back(segment.startIndex(), segment.topIndex());
+            }
+        }
+        for (Word index : largeObjects) {
+            ranges.emplace_back(index, index + 1);
+        }
+
+        std::vector<std::vector<ObjectPointer>> matches(ranges.size());
+        std::atomic<size_t> nextRange(0);
+        auto walk = [this, &predicate, &ranges, &matches, &nextRange]() {
+            for (size_t range = nextRange++; range < ranges.size(); range = nextRange++) {
+                auto collect = [&predicate, &matches, range](Word index) {
+                    ObjectPointer obj = ObjectPointer::forHeaderAt(index);
+                    if (predicate(obj)) {
+                        matches[range].push_back(obj);
+                    }
+                };
+                forEachObjectIn(ranges[range].first, ranges[range].second, collect);
+            }
+        };
+
+        size_t numberOfWalkers = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), ranges.size());
+        std::vector<std::thread> walkers;
+        for (size_t walker = 1; walker < numberOfWalkers; walker++) {
+            walkers.emplace_back(walk);
+        }
+        walk();
+        for (std::thread& walker : walkers) {
+            walker.join();
+        }
+
+        std::vector<ObjectPointer> result;
+        for (std::vector<ObjectPointer>& match : matches) {
+            result.insert(result.end(), match.begin(), match.end());
+        }
+
+        // The result might contain objects which were unreachable when the current marking started. As these are
+        // now reachable again, they have to be traced just like overwritten pointers...
+        if (markingActive) {
+            markingLog.insert(markingLog.end(), result.begin(), result.end());
+        }
+
+        return result;
+    }
+
+    std::vector<ObjectPointer> MemoryManager::allInstancesOf(ObjectPointer type) {
+        // A type without a class index has never been instantiated...
+        if (type == Nil::NIL || !type.isObject() || type.size() <= ObjectPointer::TYPE_FIELD_CLASS_INDEX ||
+            !type[ObjectPointer::TYPE_FIELD_CLASS_INDEX].isSmallInt()) {
+            return {};
+        }
+
+        auto classIndex = static_cast<uint32_t>(type[ObjectPointer::TYPE_FIELD_CLASS_INDEX].smallInt());
+        return findObjects([classIndex](ObjectPointer obj) { return obj.classIndex() == classIndex; });
+    }
+
+    std::vector<ObjectPointer> MemoryManager::allReferencesTo(ObjectPointer target) {
+        if ((!target.isObject() && !target.isBuffer()) || target == Nil::NIL) {
+            return {};
+        }
+
+        return findObjects([target](ObjectPointer obj) {
+            if (!obj.isObject()) {
+                return false;
+            }
+
+            auto fields = reinterpret_cast<ObjectPointer*>(basePointer + obj.index() + HEADER_SIZE);
+            return std::find(fields, fields + obj.size(), target) != fields + obj.size();
+        });
+    }
+
+    /**
+     * Places a large object on its own pages. A freed range is reused (first fit) if possible, otherwise the
+     * object is appended to the large object space. As the pages are freshly committed, they are zero filled.
+     */
+    Word MemoryManager::allocateLargeObject(Word numberOfWords) {
+        Word pagedWords = (numberOfWords + PAGE_WORDS - 1) / PAGE_WORDS * PAGE_WORDS;
+        if (heapWords() + pagedWords > hardLimitWords) {
+            throw std::runtime_error("Running out of memory!");
+        }
+
+        Word result = largeObjectAllocationIndex;
+
+        auto range = std::find_if(freeLargeObjectRanges.begin(), freeLargeObjectRanges.end(),
+                                  [pagedWords](const auto& freeRange) { return freeRange.second >= pagedWords; });
+        if (range != freeLargeObjectRanges.end()) {
+            result = range->first;
+            if (range->second > pagedWords) {
+                freeLargeObjectRanges[result + pagedWords] = range->second - pagedWords;
+            }
+            freeLargeObjectRanges.erase(range);
+        } else if (largeObjectAllocationIndex + pagedWords <= largeObjectEndIndex) {
+            largeObjectAllocationIndex += pagedWords;
+        } else {
+            throw std::runtime_error("Running out of large object memory!");
+        }
+
+        commit(result, pagedWords);
+        largeObjects.push_back(result);
+        largeObjectWords += pagedWords;
+        checkSoftLimit();
+
+        // Large objects are initialized without a write barrier, just like the ones directly put in the old space...
+        std::fill(cards + (result >> ObjectPointer::CARD_SHIFT),
+                  cards + ((result + numberOfWords) >> ObjectPointer::CARD_SHIFT) + 1,
+                  ObjectPointer::CARD_DIRTY);
+
+        return result;
+    }
+
+    void MemoryManager::releaseLargeObject(Word index, Word numberOfWords) {
+        Word pagedWords = (numberOfWords + PAGE_WORDS - 1) / PAGE_WORDS * PAGE_WORDS;
+        decommit(index, pagedWords);
+        std::fill(cards + (index >> ObjectPointer::CARD_SHIFT),
+                  cards + ((index + pagedWords) >> ObjectPointer::CARD_SHIFT),
+                  ObjectPointer::CARD_CLEAN);
+        largeObjectWords -= pagedWords;
+
+        // Merge the range with its free neighbours...
+        auto next = freeLargeObjectRanges.find(index + pagedWords);
+        if (next != freeLargeObjectRanges.end()) {
+            pagedWords += next->second;
+            freeLargeObjectRanges.erase(next);
+        }
+
+        auto previous = freeLargeObjectRanges.lower_bound(index);
+        if (previous != freeLargeObjectRanges.begin() &&
+            std::prev(previous)->first + std::prev(previous)->second == index) {
+            previous = std::prev(previous);
+            index = previous->first;
+            pagedWords += previous->second;
+            freeLargeObjectRanges.erase(previous);
+        }
+
+        if (index + pagedWords == largeObjectAllocationIndex) {
+            largeObjectAllocationIndex = index;
+        } else {
+            freeLargeObjectRanges[index] = pagedWords;
+        }
+    }
+
+    /**
+     * Releases all unmarked large objects. As these are never moved, the marked ones only need to be unmarked again.
+     */
+    void MemoryManager::sweepLargeObjects() {
+        std::vector<Word> survivors;
+        for (Word index : largeObjects) {
+            ObjectPointer obj = ObjectPointer::forHeaderAt(index);
+            if (obj.gcInfo() == STATE_MARKED) {
+                obj.gcInfo(STATE_ORIGINAL);
+                survivors.push_back(index);
+            } else {
+                releaseLargeObject(index, obj.size() + HEADER_SIZE);
+            }
+        }
+
+        largeObjects = std::move(survivors);
+    }
+
+    /**
+     * Releases the memory of all external buffers which didn't survive the current collection. A scavenge only
+     * decides upon young buffers, all others are only released once a marking has been completed.
+     */
+    void MemoryManager::sweepExternalBuffers(bool markingCompleted) {
+        std::vector<ObjectPointer> buffers;
+        buffers.swap(externalBuffers);
+        for (ObjectPointer buffer : buffers) {
+            if (isYoung(buffer)) {
+                if (buffer.gcInfo() != STATE_FORWARDED) {
+                    std::free(buffer.external()->bytes);
+                    continue;
+                }
+                buffer = buffer.gcSuccessor();
+            } else if (markingCompleted && isUnmarked(buffer)) {
+                std::free(buffer.external()->bytes);
+                continue;
+            }
+
+            externalBuffers.push_back(buffer);
+        }
+    }
+
+    void MemoryManager::registerRoot(ObjectPointer& root) {
+        roots.push_back(&root);
+    }
+
+    void MemoryManager::unregisterRoot(ObjectPointer& root) {
+        roots.erase(std::remove(roots.begin(), roots.end(), &root), roots.end());
+    }
+
+    Word MemoryManager::allocateInOldSpace(Word numberOfWords) {
+        Word result = oldSpace.alloc(numberOfWords);
+        if (result == 0) {
+            takeSegment();
+            result = oldSpace.alloc(numberOfWords);
+        }
+
+        recordObjectStart(result, numberOfWords);
+        return result;
+    }
+
+    /**
+     * Allocates an object on behalf of the interpreter in the old space. In contrast to the promotion of objects by
+     * a collection, this must not grow the heap beyond the hard limit.
+     */
+    Word MemoryManager::allocateDirtyInOldSpace(Word numberOfWords) {
+        if (heapWords() >= hardLimitWords) {
+            throw std::runtime_error("Running out of memory!");
+        }
+
+        Word result = allocateInOldSpace(numberOfWords);
+        std::fill(cards + (result >> ObjectPointer::CARD_SHIFT),
+                  cards + ((result + numberOfWords) >> ObjectPointer::CARD_SHIFT) + 1,
+                  ObjectPointer::CARD_DIRTY);
+
+        return result;
+    }
+
+    /**
+     * Blocks until the nurseryZeroer has wiped the nursery up to the given index. As it zeroes much faster than
+     * objects are initialized, this is rarely the case.
+     */
+    void MemoryManager::awaitZeroedNursery(Word index) {
+        while ((nurseryZeroedIndex = nurseryZeroer.zeroedIndex()) < index) {
+            std::this_thread::yield();
+        }
+    }
+
+    /**
+     * Records the given object as the one covering the first word of each card it spans. This permits to
+     * find the first object to scan for a dirty card.
+     */
+    void MemoryManager::recordObjectStart(Word index, Word numberOfWords) {
+        Word firstCard = (index + ObjectPointer::CARD_SIZE - 1) >> ObjectPointer::CARD_SHIFT;
+        Word lastCard = (index + numberOfWords - 1) >> ObjectPointer::CARD_SHIFT;
+        for (Word card = firstCard; card <= lastCard; card++) {
+            crossingObjects[card] = index;
+        }
+    }
+
+    ObjectPointer MemoryManager::forward(ObjectPointer obj) {
+        if (!isYoung(obj)) {
+            return obj;
+        }
+
+        if (obj.gcInfo() == STATE_FORWARDED) {
+            return obj.gcSuccessor();
+        }
+
+        Word numberOfWords = obj.size() + HEADER_SIZE;
+        Word newIndex = allocateInOldSpace(numberOfWords);
+        std::memcpy(basePointer + newIndex, basePointer + obj.index(), numberOfWords * sizeof(Word));
+
+        ObjectPointer copy = ObjectPointer::forObject((newIndex << 2) | (obj.data & ObjectPointer::TYPE_MASK));
+        obj.gcInfo(STATE_FORWARDED);
+        obj.gcSuccessor(copy);
+
+        return copy;
+    }
+
+    Word MemoryManager::scavengeObject(Word index) {
+        ObjectPointer obj = ObjectPointer::forHeaderAt(index);
+        Word numberOfFields = static_cast<Word>(obj.size());
+        if (obj.isObject()) {
+            ObjectPointer* fields = reinterpret_cast<ObjectPointer*>(basePointer + index + HEADER_SIZE);
+            for (Word i = 0; i < numberOfFields; i++) {
+                fields[i] = forward(fields[i]);
+            }
+        }
+
+        return index + numberOfFields + HEADER_SIZE;
+    }
+
+    /**
+     * Scavenges all fields which are located within the given card. An object might span several cards, therefore
+     * only the fields within the card are inspected, so that large arrays are only partially rescanned.
+     */
+    void MemoryManager::scavengeCard(Word card, Word firstObject, Word limit) {
+        Word cardStart = std::max(card << ObjectPointer::CARD_SHIFT, firstObject);
+        Word cardEnd = std::min((card + 1) << ObjectPointer::CARD_SHIFT, limit);
+
+        Word index = firstObject;
+        while (index < cardEnd) {
+            ObjectPointer obj = ObjectPointer::forHeaderAt(index);
+            Word next = index + static_cast<Word>(obj.size()) + HEADER_SIZE;
+            if (obj.isObject()) {
+                ObjectPointer* heap = reinterpret_cast<ObjectPointer*>(basePointer);
+                for (Word field = std::max(index + HEADER_SIZE, cardStart); field < std::min(next, cardEnd); field++) {
+                    heap[field] = forward(heap[field]);
+                }
+            }
+
+            index = next;
+        }
+    }
+
+    void MemoryManager::scavenge() {
+        Word oldWords = oldSpace.usedWords();
+        size_t promotedSegment = oldSpace.current();
+        Word promotedIndex = oldSpace.segment(promotedSegment).topIndex();
+
+        for (ObjectPointer* root : roots) {
+            *root = forward(*root);
+        }
+
+        for (ObjectPointer& type : ObjectPointer::classTable) {
+            type = forward(type);
+        }
+
+        for (ObjectPointer& ephemeron : finalizationRegistry) {
+            ephemeron = forward(ephemeron);
+        }
+
+        for (ObjectPointer& finalizer : finalizationQueue) {
+            finalizer = forward(finalizer);
+        }
+
+        // The first word of the heap is "nil", therefore the root objects start at index 1...
+        for (Word index = 1; index < rootAllocationIndex;) {
+            index = scavengeObject(index);
+        }
+
+        // Only the dirty cards of the old space can contain pointers into the nursery. Segments are aligned to
+        // cards, therefore each card belongs to exactly one segment...
+        for (size_t index = 0; index < oldSpace.usedSegmentLimit(); index++) {
+            Segment& segment = oldSpace.segment(index);
+            Word limit = index == promotedSegment ? promotedIndex : segment.topIndex();
+            if (!segment.inUse() || limit == segment.startIndex()) {
+                continue;
+            }
+
+            for (Word card = segment.startIndex() >> ObjectPointer::CARD_SHIFT;
+                 card <= (limit - 1) >> ObjectPointer::CARD_SHIFT; card++) {
+                if (cards[card] == ObjectPointer::CARD_DIRTY) {
+                    scavengeCard(card, std::max(crossingObjects[card], segment.startIndex()), limit);
+                }
+            }
+        }
+
+        // ...as well as the dirty cards of large objects. Note that these are cleaned right away, as the old space
+        // cards are bulk-cleaned below...
+        for (Word index : largeObjects) {
+            Word end = index + ObjectPointer::forHeaderAt(index).size() + HEADER_SIZE;
+            Word lastCard = (end - 1) >> ObjectPointer::CARD_SHIFT;
+            for (Word card = index >> ObjectPointer::CARD_SHIFT; card <= lastCard; card++) {
+                if (cards[card] == ObjectPointer::CARD_DIRTY) {
+                    scavengeCard(card, index, end);
+                    cards[card] = ObjectPointer::CARD_CLEAN;
+                }
+            }
+        }
+
+        // Breadth first scan of all promoted objects (Cheney) - this will promote all transitively reachable
+        // objects, which are appended to the current segment and therefore also picked up by this loop. Once a
+        // segment is exhausted, we follow the chain of segments which have been taken in the meantime...
+        size_t scanSegment = promotedSegment;
+        Word scanIndex = promotedIndex;
+        while (true) {
+            while (scanIndex < oldSpace.segment(scanSegment).topIndex()) {
+                scanIndex = scavengeObject(scanIndex);
+            }
+
+            scanSegment = oldSpace.segment(scanSegment).successorSegment();
+            if (scanSegment == Segment::NONE) {
+                break;
+            }
+            scanIndex = oldSpace.segment(scanSegment).startIndex();
+        }
+
+        // The nursery is wiped below, therefore dead external buffers and sampled allocations have to be
+        // inspected now...
+        sweepExternalBuffers(false);
+        updateAllocationSites();
+
+        // As the nursery is now empty, there are no more pointers from the old space into it...
+        for (size_t index = 0; index < oldSpace.usedSegmentLimit(); index++) {
+            Segment& segment = oldSpace.segment(index);
+            if (segment.inUse() && segment.topIndex() > segment.startIndex()) {
+                std::fill(cards + (segment.startIndex() >> ObjectPointer::CARD_SHIFT),
+                          cards + ((segment.topIndex() - 1) >> ObjectPointer::CARD_SHIFT) + 1,
+                          ObjectPointer::CARD_CLEAN);
+            }
+        }
+
+        // Fresh objects are never initialized by makeObject, therefore we need to wipe the nursery. This is done in
+        // the background, as the allocation only has to wait for the zeroer once it catches up with it...
+        nurseryZeroer.zero(basePointer, nurseryStartIndex, nurseryAllocationIndex, nurseryEndIndex);
+        nurseryZeroedIndex = nurseryStartIndex;
+        nurseryAllocationIndex = nurseryStartIndex;
+        lastPromotedWords = oldSpace.usedWords() - oldWords;
+        if (nextMarkingStepIndex != NO_MARKING_STEP) {
+            nextMarkingStepIndex = nurseryAllocationIndex + MARKING_STEP_WORDS;
+        }
+    }
+
+    void MemoryManager::runRecommendedGC() {
+        weakReferencesCleared = false;
+        finalizersQueued = false;
+        lowSpaceDetected = false;
+        auto start = std::chrono::steady_clock::now();
+        Word wordsBefore = occupiedWords();
+
+        // Promoting the whole nursery must not push the old space beyond its limit...
+        if (lowSpaceRequested || markingComplete || oldSpace.usedWords() + (nurseryAllocationIndex - nurseryStartIndex) >= oldSpaceGCWords ||
+            largeObjectWords >= largeObjectGCWords) {
+            fullGC();
+            recordCollection(CollectionKind::FULL, start, wordsBefore);
+            return;
+        }
+
+        scavenge();
+
+        // As the nursery is empty right after a scavenge, this is the perfect moment to take the snapshot for an
+        // incremental marking...
+        if (!markingActive && oldSpace.usedWords() >= markingStartWords) {
+            startMarking();
+        }
+        recordCollection(CollectionKind::SCAVENGE, start, wordsBefore);
+    }
+
+    void MemoryManager::runFullGC() {
+        weakReferencesCleared = false;
+        finalizersQueued = false;
+        lowSpaceDetected = false;
+        auto start = std::chrono::steady_clock::now();
+        Word wordsBefore = occupiedWords();
+
+        fullGC();
+        recordCollection(CollectionKind::FULL, start, wordsBefore);
+    }
+
+    void MemoryManager::recordCollection(CollectionKind kind, std::chrono::steady_clock::time_point start,
+                                         Word wordsBefore) {
+        auto pause = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        Word wordsAfter = occupiedWords();
+        bool collected = kind != CollectionKind::MARKING_STEP;
+        gcLog.record({kind, static_cast<uint64_t>(pause.count()),
+                      collected ? lastPromotedWords * sizeof(Word) : 0,
+                      wordsBefore > wordsAfter ? (wordsBefore - wordsAfter) * sizeof(Word) : 0,
+                      wordsBefore * sizeof(Word), wordsAfter * sizeof(Word)});
+    }
+
+    void MemoryManager::fullGC() {
+        scavenge();
+        if (!markingActive) {
+            startMarking();
+        }
+        finishMarking();
+        clearWeakReferences();
+        sweepLargeObjects();
+        sweepExternalBuffers(true);
+        evacuate();
+
+        updateCollectionThresholds();
+
+        // If we're still beyond the soft limit, the image is notified once. The soft limit is only checked again,
+        // once a collection got below it, as we would otherwise collect over and over again...
+        if (heapWords() < softLimitWords) {
+            lowSpaceArmed = true;
+        } else if (lowSpaceArmed) {
+            lowSpaceArmed = false;
+            lowSpaceDetected = true;
+        }
+        lowSpaceRequested = false;
+    }
+
+    /**
+     * Permits the old space to double (but to at most use half of the free segments) before collecting it again.
+     * Marking is started half way there, so that it can be completed incrementally in the meantime.
+     */
+    void MemoryManager::updateCollectionThresholds() {
+        Word usedWords = oldSpace.usedWords();
+        Word growth = std::max(usedWords, MINIMAL_OLD_SPACE_GROWTH);
+        Word freeWords = static_cast<Word>(oldSpace.numberOfFreeSegments()) * Allocator::SEGMENT_SIZE;
+        oldSpaceGCWords = usedWords + std::min(growth, freeWords / 2);
+        markingStartWords = usedWords + (oldSpaceGCWords - usedWords) / 2;
+        largeObjectGCWords = largeObjectWords + (LARGE_OBJECT_SPACE_SIZE - largeObjectWords) / 2;
+    }
+
+    void MemoryManager::mark(ObjectPointer obj, MarkStack& markStack) {
+        // Objects allocated after the marking started are implicitly live and need no tracing. Large objects
+        // allocated in the meantime are created as marked...
+        if (!isMarkable(obj)) {
+            return;
+        }
+
+        // Several markers might reach the same object, therefore the mark bit is set atomically and only the
+        // thread which actually set it is responsible for scanning the object...
+        uint32_t markBit = static_cast<uint32_t>(STATE_MARKED << 4) << ObjectPointer::FLAGS_SHIFT;
+        uint32_t header = __atomic_fetch_or(&obj.pointer()->size, markBit, __ATOMIC_RELAXED);
+        if ((header & markBit) == 0) {
+            if (isOld(obj)) {
+                oldSpace.segmentOf(obj.index()).addLiveWords((header & ObjectPointer::SIZE_MASK) + HEADER_SIZE);
+            }
+            markStack.push(obj);
+        }
+    }
+
+    Word MemoryManager::markFields(Word index, MarkStack& markStack) {
+        ObjectPointer obj = ObjectPointer::forHeaderAt(index);
+        Word numberOfFields = static_cast<Word>(obj.size());
+        markFields(obj, 0, numberOfFields, markStack);
+
+        return index + numberOfFields + HEADER_SIZE;
+    }
+
+    /**
+     * Marks the fields [from, limit) of the given object. The fields of a weak object or an ephemeron are checked
+     * when the first chunk is scanned. Returns false if they have been deferred, so that no remainder is scanned.
+     */
+    bool MemoryManager::markFields(ObjectPointer obj, Word from, Word limit, MarkStack& markStack) {
+        if (!obj.isObject()) {
+            return true;
+        }
+        if (from == 0 && obj.isWeak() && deferWeakFields(obj)) {
+            return false;
+        }
+
+        ObjectPointer* fields = reinterpret_cast<ObjectPointer*>(basePointer + obj.index() + HEADER_SIZE);
+        for (Word i = from; i < limit; i++) {
+            // Fetch the header of an upcoming field while marking the current one, as each mark is most
+            // probably a cache miss otherwise...
+            if (i + PREFETCH_DISTANCE < limit && isOld(fields[i + PREFETCH_DISTANCE])) {
+                __builtin_prefetch(basePointer + fields[i + PREFETCH_DISTANCE].index(), 1);
+            }
+            mark(fields[i], markStack);
+        }
+
+        return true;
+    }
+
+    void MemoryManager::markRemainingFields(const MarkStack::Entry& entry, MarkStack& markStack) {
+        markFields(entry.object, entry.nextField, static_cast<Word>(entry.object.size()), markStack);
+    }
+
+    /**
+     * Records a weak object or an ephemeron which key isn't marked (yet), so that it can be handled once the marking
+     * is completed. Returns true if the fields of the given object must not be traced for now.
+     */
+    bool MemoryManager::deferWeakFields(ObjectPointer obj) {
+        std::lock_guard<std::mutex> guard(referenceLock);
+        if (obj.format() == ObjectPointer::FORMAT_WEAK) {
+            weakObjects.push_back(obj);
+            return true;
+        }
+
+        if (isUnmarked(*reinterpret_cast<ObjectPointer*>(basePointer + obj.index() + HEADER_SIZE))) {
+            ephemerons.push_back(obj);
+            return true;
+        }
+
+        return false;
+    }
+
+    /**
+     * Traces all deferred ephemerons which key turned out to be reachable. As this might mark the key of another
+     * ephemeron, this is repeated until no more progress is made.
+     */
+    void MemoryManager::traceEphemerons() {
+        while (true) {
+            MarkStack::Entry entry;
+            while (grayObjects.pop(entry)) {
+                markRemainingFields(entry, grayObjects);
+            }
+
+            bool progress = false;
+            std::vector<ObjectPointer> pending;
+            pending.swap(ephemerons);
+            for (ObjectPointer ephemeron : pending) {
+                ObjectPointer* fields = reinterpret_cast<ObjectPointer*>(basePointer + ephemeron.index() + HEADER_SIZE);
+                if (isUnmarked(fields[0])) {
+                    ephemerons.push_back(ephemeron);
+                    continue;
+                }
+
+                for (Word i = 0; i < static_cast<Word>(ephemeron.size()); i++) {
+                    mark(fields[i], grayObjects);
+                }
+                progress = true;
+            }
+
+            if (!progress) {
+                return;
+            }
+        }
+    }
+
+    /**
+     * Moves the finalizer of each registered object which turned out to be unreachable into the finalizationQueue.
+     * The object itself and everything reachable from its finalizer is resurrected for this collection, therefore the
+     * ephemerons have to be traced again.
+     */
+    void MemoryManager::queueFinalizers() {
+        std::vector<ObjectPointer> registry;
+        registry.swap(finalizationRegistry);
+        for (ObjectPointer ephemeron : registry) {
+            ObjectPointer* fields = reinterpret_cast<ObjectPointer*>(basePointer + ephemeron.index() + HEADER_SIZE);
+            if (!isUnmarked(fields[0])) {
+                finalizationRegistry.push_back(ephemeron);
+                continue;
+            }
+
+            mark(fields[0], grayObjects);
+            mark(fields[1], grayObjects);
+            finalizationQueue.push_back(fields[1]);
+            finalizersQueued = true;
+        }
+
+        if (finalizersQueued) {
+            traceEphemerons();
+        }
+    }
+
+    /**
+     * Sets all fields of weak objects which point to unmarked objects to nil. Ephemerons which key is unmarked are
+     * cleared entirely, as none of their fields has been traced.
+     */
+    void MemoryManager::clearWeakReferences() {
+        for (ObjectPointer obj : weakObjects) {
+            ObjectPointer* fields = reinterpret_cast<ObjectPointer*>(basePointer + obj.index() + HEADER_SIZE);
+            for (Word i = 0; i < static_cast<Word>(obj.size()); i++) {
+                if (isUnmarked(fields[i])) {
+                    fields[i] = Nil::NIL;
+                    weakReferencesCleared = true;
+                }
+            }
+        }
+
+        for (ObjectPointer ephemeron : ephemerons) {
+            ObjectPointer* fields = reinterpret_cast<ObjectPointer*>(basePointer + ephemeron.index() + HEADER_SIZE);
+            std::fill(fields, fields + ephemeron.size(), Nil::NIL);
+            weakReferencesCleared = true;
+        }
+
+        weakObjects.clear();
+        ephemerons.clear();
+    }
+
+    /**
+     * Processes gray objects until all mark stacks are empty. Once the own stack is exhausted, work is stolen from
+     * the other markers. A marker only terminates once all markers are idle, as only then no more work can appear.
+     */
+    void MemoryManager::drainMarkStacks(size_t worker, std::vector<MarkStack>& markStacks,
+                                        std::atomic<size_t>& idleMarkers) {
+        MarkStack& markStack = markStacks[worker];
+        MarkStack::Entry entry;
+        while (true) {
+            while (markStack.pop(entry)) {
+                markRemainingFields(entry, markStack);
+            }
+
+            bool stolen = false;
+            for (size_t i = 1; i < markStacks.size() && !stolen; i++) {
+                stolen = markStacks[(worker + i) % markStacks.size()].steal(entry);
+            }
+
+            if (stolen) {
+                markRemainingFields(entry, markStack);
+                continue;
+            }
+
+            idleMarkers++;
+            while (true) {
+                if (idleMarkers.load() == markStacks.size()) {
+                    return;
+                }
+
+                if (std::any_of(markStacks.begin(), markStacks.end(),
+                                [](const MarkStack& stack) { return !stack.empty(); })) {
+                    idleMarkers--;
+                    break;
+                }
+
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    /**
+     * Starts a marking by graying all roots. From now on, all overwritten pointers are recorded in the markingLog
+     * (snapshot at the beginning), therefore the remaining marking can be performed in small steps which are
+     * interleaved with the execution of the interpreter.
+     */
+    void MemoryManager::startMarking() {
+        markingActive = true;
+        for (size_t index = 0; index < oldSpace.usedSegmentLimit(); index++) {
+            oldSpace.segment(index).startMarking();
+        }
+        nextMarkingStepIndex = nurseryAllocationIndex + MARKING_STEP_WORDS;
+        ObjectPointer::markingLog = &markingLog;
+
+        for (ObjectPointer* root : roots) {
+            mark(*root, grayObjects);
+        }
+
+        for (ObjectPointer type : ObjectPointer::classTable) {
+            mark(type, grayObjects);
+        }
+
+        for (ObjectPointer ephemeron : finalizationRegistry) {
+            mark(ephemeron, grayObjects);
+        }
+
+        for (ObjectPointer finalizer : finalizationQueue) {
+            mark(finalizer, grayObjects);
+        }
+
+        for (Word index = 1; index < rootAllocationIndex;) {
+            index = markFields(index, grayObjects);
+        }
+    }
+
+    bool MemoryManager::idleGC(SmallInteger budgetMicros) {
+        if (markingActive && !markingComplete) {
+            performMarkingStep(budgetMicros);
+            return false;
+        }
+
+        runRecommendedGC();
+        return true;
+    }
+
+    /**
+     * Both the markingLog and the gray objects are processed in chunks of about MARKING_CHUNK_FIELDS, after each of
+     * which the budget is checked. Unfinished work (including the remainder of a large object) stays queued for the
+     * next step.
+     * <p>
+     * A step ends as soon as another chunk, taking as long as the longest one so far, would exceed the budget.
+     * Therefore the work of a step stays within its budget. What the clock cannot bound is the time the thread
+     * isn't scheduled at all: on a single, shared core, a step is occasionally preempted for a whole time slice
+     * (several milliseconds), which then shows up as its pause in the gcLog.
+     */
+    void MemoryManager::performMarkingStep(SmallInteger budgetMicros) {
+        auto start = std::chrono::steady_clock::now();
+        nextMarkingStepIndex = nurseryAllocationIndex + MARKING_STEP_WORDS;
+        auto budget = std::chrono::microseconds(budgetMicros);
+        auto lastCheck = start;
+        std::chrono::steady_clock::duration longestChunk(0);
+        auto budgetElapsed = [start, budget, &lastCheck, &longestChunk]() {
+            auto now = std::chrono::steady_clock::now();
+            longestChunk = std::max(longestChunk, now - lastCheck);
+            lastCheck = now;
+            return now - start + longestChunk >= budget;
+        };
+
+        // The log is consumed from its end, so that the remainder simply stays in place...
+        Word work = 0;
+        while (!markingLog.empty()) {
+            mark(markingLog.back(), grayObjects);
+            markingLog.pop_back();
+            if (++work >= MARKING_CHUNK_FIELDS) {
+                work = 0;
+                if (budgetElapsed()) {
+                    recordCollection(CollectionKind::MARKING_STEP, start, occupiedWords());
+                    return;
+                }
+            }
+        }
+
+        MarkStack::Entry entry;
+        while (grayObjects.pop(entry)) {
+            Word numberOfFields = entry.object.isObject() ? static_cast<Word>(entry.object.size()) : 0;
+            Word limit = std::min(numberOfFields, entry.nextField + MARKING_CHUNK_FIELDS);
+            if (markFields(entry.object, entry.nextField, limit, grayObjects) && limit < numberOfFields) {
+                grayObjects.push(entry.object, limit);
+            }
+
+            // Each object counts as one unit of work, even if it has no fields...
+            work += limit - entry.nextField + 1;
+            if (work >= MARKING_CHUNK_FIELDS) {
+                work = 0;
+                if (budgetElapsed()) {
+                    recordCollection(CollectionKind::MARKING_STEP, start, occupiedWords());
+                    return;
+                }
+            }
+        }
+
+        // All gray objects are processed - the evacuation is performed at the next safepoint...
+        markingComplete = true;
+        nextMarkingStepIndex = NO_MARKING_STEP;
+        recordCollection(CollectionKind::MARKING_STEP, start, occupiedWords());
+    }
+
+    /**
+     * Completes the current marking by processing all remaining gray objects using one marker per core.
+     */
+    void MemoryManager::finishMarking() {
+        size_t numberOfMarkers = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<MarkStack> markStacks(numberOfMarkers);
+
+        // Distribute the remaining work among all markers so that these can start right away...
+        size_t nextMarker = 0;
+        for (ObjectPointer obj : markingLog) {
+            mark(obj, markStacks[nextMarker++ % numberOfMarkers]);
+        }
+        markingLog.clear();
+
+        MarkStack::Entry entry;
+        while (grayObjects.pop(entry)) {
+            markStacks[nextMarker++ % numberOfMarkers].push(entry.object, entry.nextField);
+        }
+
+        std::atomic<size_t> idleMarkers(0);
+        std::vector<std::thread> markers;
+        for (size_t worker = 1; worker < numberOfMarkers; worker++) {
+            markers.emplace_back([this, worker, &markStacks, &idleMarkers]() {
+                drainMarkStacks(worker, markStacks, idleMarkers);
+            });
+        }
+
+        drainMarkStacks(0, markStacks, idleMarkers);
+        for (std::thread& marker : markers) {
+            marker.join();
+        }
+
+        traceEphemerons();
+        queueFinalizers();
+
+        ObjectPointer::markingLog = nullptr;
+        markingActive = false;
+        markingComplete = false;
+        nextMarkingStepIndex = NO_MARKING_STEP;
+    }
+
+    ObjectPointer MemoryManager::relocated(ObjectPointer obj) {
+        if (isOld(obj) && oldSpace.segmentOf(obj.index()).isEvacuating()) {
+            return obj.gcSuccessor();
+        }
+
+        return obj;
+    }
+
+    Word MemoryManager::relocateFields(Word index) {
+        ObjectPointer obj = ObjectPointer::forHeaderAt(index);
+        Word numberOfFields = static_cast<Word>(obj.size());
+        if (obj.isObject()) {
+            ObjectPointer* fields = reinterpret_cast<ObjectPointer*>(basePointer + index + HEADER_SIZE);
+            for (Word i = 0; i < numberOfFields; i++) {
+                fields[i] = relocated(fields[i]);
+            }
+        }
+
+        return index + numberOfFields + HEADER_SIZE;
+    }
+
+    /**
+     * Selects the segments to evacuate. These are the ones with the least live words, as long as the copied words
+     * fit into the free segments and stay within the EVACUATION_BUDGET. The current segment is never evacuated, as
+     * the survivors of the other segments are appended to it.
+     */
+    void MemoryManager::selectEvacuationSet() {
+        std::vector<size_t> candidates;
+        for (size_t index = 0; index < oldSpace.usedSegmentLimit(); index++) {
+            Segment& segment = oldSpace.segment(index);
+            if (segment.inUse() && index != oldSpace.current() &&
+                segment.liveWords() * 100 < Allocator::SEGMENT_SIZE * EVACUATION_LIVE_PERCENT) {
+                candidates.push_back(index);
+            }
+        }
+
+        std::sort(candidates.begin(), candidates.end(), [](size_t left, size_t right) {
+            return oldSpace.segment(left).liveWords() < oldSpace.segment(right).liveWords();
+        });
+
+        // A segment might end up with an unused tail of up to LARGE_OBJECT_THRESHOLD words, once the next object
+        // doesn't fit anymore...
+        Segment& current = oldSpace.segment(oldSpace.current());
+        Word available = current.endIndex() - current.topIndex() +
+                         static_cast<Word>(oldSpace.numberOfFreeSegments()) *
+                         (Allocator::SEGMENT_SIZE - LARGE_OBJECT_THRESHOLD);
+        Word budget = std::min(available, EVACUATION_BUDGET);
+        Word copiedWords = 0;
+        for (size_t index : candidates) {
+            Segment& segment = oldSpace.segment(index);
+            if (copiedWords + segment.liveWords() > budget) {
+                return;
+            }
+
+            segment.evacuate();
+            copiedWords += segment.liveWords();
+        }
+    }
+
+    /**
+     * Copies all live objects out of the segments with the most garbage (see selectEvacuationSet). The new location
+     * of each object is stored as its gcSuccessor, so that all references can be updated afterwards. The dead
+     * objects of the remaining segments are turned into fillers, as these might be scanned again (e.g. as part of a
+     * dirty card). Once everything is updated, the evacuated segments are handed back to the operating system.
+     */
+    void MemoryManager::evacuate() {
+        selectEvacuationSet();
+
+        // Copy the survivors...
+        for (size_t index = 0; index < oldSpace.usedSegmentLimit(); index++) {
+            Segment& segment = oldSpace.segment(index);
+            if (!segment.isEvacuating()) {
+                continue;
+            }
+
+            for (Word objectIndex = segment.startIndex(); objectIndex < segment.topIndex();) {
+                ObjectPointer obj = ObjectPointer::forHeaderAt(objectIndex);
+                Word numberOfWords = static_cast<Word>(obj.size()) + HEADER_SIZE;
+                if (survives(objectIndex, obj)) {
+                    Word newIndex = allocateInOldSpace(numberOfWords);
+                    std::memcpy(basePointer + newIndex, basePointer + objectIndex, numberOfWords * sizeof(Word));
+                    ObjectPointer copy = ObjectPointer::forObject(
+                            (newIndex << 2) | (obj.data & ObjectPointer::TYPE_MASK));
+                    copy.gcInfo(STATE_ORIGINAL);
+                    obj.gcInfo(STATE_FORWARDED);
+                    obj.gcSuccessor(copy);
+                }
+                objectIndex += numberOfWords;
+            }
+        }
+
+        // Update all references to the new locations...
+        for (ObjectPointer* root : roots) {
+            *root = relocated(*root);
+        }
+
+        for (ObjectPointer& type : ObjectPointer::classTable) {
+            type = relocated(type);
+        }
+
+        for (ObjectPointer& ephemeron : finalizationRegistry) {
+            ephemeron = relocated(ephemeron);
+        }
+
+        for (ObjectPointer& finalizer : finalizationQueue) {
+            finalizer = relocated(finalizer);
+        }
+
+        for (ObjectPointer& buffer : externalBuffers) {
+            buffer = relocated(buffer);
+        }
+
+        for (Word index = 1; index < rootAllocationIndex;) {
+            index = relocateFields(index);
+        }
+
+        for (Word index : largeObjects) {
+            relocateFields(index);
+        }
+
+        // ...including the ones in all remaining segments - this includes the copies made above...
+        for (size_t index = 0; index < oldSpace.usedSegmentLimit(); index++) {
+            Segment& segment = oldSpace.segment(index);
+            if (!segment.inUse() || segment.isEvacuating()) {
+                continue;
+            }
+
+            for (Word objectIndex = segment.startIndex(); objectIndex < segment.topIndex();) {
+                ObjectPointer obj = ObjectPointer::forHeaderAt(objectIndex);
+                Word numberOfWords = static_cast<Word>(obj.size()) + HEADER_SIZE;
+                if (survives(objectIndex, obj)) {
+                    relocateFields(objectIndex);
+                    obj.gcInfo(STATE_ORIGINAL);
+                } else {
+                    obj.format(ObjectPointer::FORMAT_FILLER);
+                    obj.gcInfo(STATE_ORIGINAL);
+                    obj.pointer()->classIndex = 0;
+                }
+                objectIndex += numberOfWords;
+            }
+        }
+
+        // The cards of the evacuated segments are all clean, as the nursery is empty. Their memory is simply handed
+        // back to the operating system, so that it is zero filled once the segment is taken again...
+        for (size_t index = 0; index < oldSpace.usedSegmentLimit(); index++) {
+            Segment& segment = oldSpace.segment(index);
+            if (segment.isEvacuating()) {
+                decommit(segment.startIndex(), Allocator::SEGMENT_SIZE);
+                oldSpace.releaseSegment(index);
+            }
+        }
+    }
 
 }
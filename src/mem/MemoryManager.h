@@ -7,86 +7,724 @@
 
 #include "../common/ObjectPointer.h"
 #include "Allocator.h"
+#include "MarkStack.h"
+#include "Zeroer.h"
+#include "GCLog.h"
+#include "HeapDump.h"
+#include "Image.h"
 
 #include <list>
+#include <map>
+#include <unordered_map>
+#include <mutex>
 #include <vector>
 #include <deque>
 #include <chrono>
+#include <functional>
 #include <iostream>
 
 namespace pimii {
 
+    /**
+     * Determines if and how huge pages are used to back the heap.
+     */
+    enum class HugePages {
+        NONE,
+        TRANSPARENT,
+        EXPLICIT
+    };
+
+    /**
+     * Collects the survival statistics of all objects allocated by a single allocation site. Sites which objects
+     * mostly survive their first scavenge are pretenured, i.e. they directly allocate in the old space.
+     */
+    struct AllocationSite {
+        uint32_t allocations;
+        uint32_t samples;
+        uint32_t survivors;
+        bool pretenured;
+    };
+
+    /**
+     * Tracks the allocations caused by a single send, identified by a method and the IP after the send (see
+     * Interpreter::allocationSite). If the send invokes an allocating primitive, the objects are attributed to site.
+     * If it invokes a method which allocates, the first allocating send within that callee is remembered (like an
+     * inline cache) and its objects are attributed to calleeSite. This way, generic methods like Behaviour>>new:
+     * are told apart by their callers without hashing.
+     */
+    struct SendSite {
+        AllocationSite site;
+        uint32_t calleeTable;
+        uint32_t calleeIP;
+        AllocationSite calleeSite;
+    };
+
+    /**
+     * Counts the instances of a single class and the bytes these occupy (see MemoryManager::census).
+     */
+    struct ClassCensus {
+        uint64_t instances;
+        uint64_t bytes;
+    };
+
+    /**
+     * Manages the heap which is split into three areas:
+     * <ul>
+     *     <li>the root region, which contains objects which are never moved and which are always treated as roots</li>
+     *     <li>the nursery, in which all new objects are bump allocated. After each scavenge, it is wiped by the
+     *     nurseryZeroer, which runs ahead of the allocation</li>
+     *     <li>the old space, into which all objects surviving a scavenge of the nursery are promoted. It is split
+     *     into segments of Allocator::SEGMENT_SIZE words, which are only committed while they are in use</li>
+     * </ul>
+     * Objects larger than LARGE_OBJECT_THRESHOLD are placed on their own pages in the large object space, which is
+     * reserved right above the heap. These objects are never moved and are released as soon as a full collection
+     * no longer marks them.
+     * <p>
+     * A collection is only ever performed at a safepoint of the interpreter (see Interpreter::run), therefore
+     * all ObjectPointers held by C++ code need to be registered via registerRoot so that they can be updated.
+     * <p>
+     * Each object starts with a 64 bit header, which contains its size, its GC state and the index of its type in
+     * ObjectPointer::classTable. All registered types are treated as roots.
+     * <p>
+     * Pointers from the old space into the nursery are tracked by a card table, which is marked by
+     * ObjectPointer::store. Objects which are directly allocated in the old space start with dirty cards, as
+     * they are commonly initialized without a write barrier.
+     * <p>
+     * Weak objects and ephemerons (see ObjectPointer::FORMAT_WEAK) are only handled by a full collection. A scavenge
+     * treats their fields like any other.
+     * <p>
+     * Objects registered via registerFinalizer are kept in finalizationRegistry as ephemerons, which map the object to
+     * its finalizer. Once a full collection finds such an object unreachable, its finalizer is moved into the
+     * finalizationQueue, from which it is fetched by a Smalltalk process (see nextFinalizer).
+     * <p>
+     * Objects allocated on behalf of an AllocationSite are sampled until the next scavenge, which records whether
+     * they survived. Sites which objects consistently survive allocate directly in the old space.
+     * <p>
+     * The bytes of external buffers (see ObjectPointer::FORMAT_EXTERNAL) are allocated outside of the heap. All
+     * external buffers are tracked in externalBuffers so that their memory can be released once they are collected.
+     * <p>
+     * The old space is collected by a mark-evacuate collector. Marking is started once the old space is half way
+     * to its limit and then performed incrementally in small steps (see performMarkingStep). The remaining work
+     * of a marking is completed by one thread per core, each owning a MarkStack from which idle threads steal work.
+     * While marking, the live words of each Segment are accounted, so that only the segments which contain the most
+     * garbage are evacuated (see evacuate). The dead objects of all other segments are turned into fillers
+     * (see ObjectPointer::FORMAT_FILLER) and remain in place until their segment is evacuated.
+     * <p>
+     * The committed heap (see heapWords) is bounded by two limits. Once it grows beyond the soft limit, a full
+     * collection is performed at the next safepoint. If this doesn't free enough memory, hasLowSpace reports so,
+     * in order to notify the image. Allocations of the interpreter beyond the hard limit fail.
+     * <p>
+     * If an allocation profiler is installed (see profileAllocations), about every n-th allocated byte is reported to
+     * it. This only costs a subtraction per allocation, so that profiling can remain enabled in production.
+     * <p>
+     * Each scavenge, full collection and incremental marking step is recorded in the gcLog.
+     */
     class MemoryManager {
         static Word* basePointer;
         static Word rootAllocationIndex;
         static Word rootEndIndex;
-        static Word allocationIndex;
+        static Word nurseryStartIndex;
+        static Word nurseryAllocationIndex;
+        static Word nurseryGCIndex;
+        static Word nurseryEndIndex;
+        static Word nurseryZeroedIndex;
+        static Zeroer nurseryZeroer;
+        static Word oldSpaceStartIndex;
+        static Word oldSpaceEndIndex;
+        static Allocator oldSpace;
+        static Word oldSpaceGCWords;
         static Word endIndex;
         static Word size;
-        /*
-        SmallInteger maxSegmentsPerPool;
-        SmallInteger buffersLowWaterMark;
-        SmallInteger buffersHighWaterMark;
-        SmallInteger objectsLowWaterMark;
-        SmallInteger objectsHighWaterMark;
-        std::unique_ptr<Allocator> rootAllocator;
-        std::list<ObjectPointer> rootObjects;
-        std::unique_ptr<Allocator> activeObjects;
-        std::unique_ptr<Allocator> buffers;
+        static HugePages hugePages;
+        static std::vector<ObjectPointer*> roots;
+        static uint8_t* cards;
+        static Word* crossingObjects;
+        static bool markingActive;
+        static bool markingComplete;
+        static Word markingStartWords;
+        static Word nextMarkingStepIndex;
+        static SmallInteger markingStepMicros;
+        static MarkStack grayObjects;
+        static std::vector<ObjectPointer> markingLog;
+        static Word largeObjectStartIndex;
+        static Word largeObjectAllocationIndex;
+        static Word largeObjectEndIndex;
+        static Word largeObjectWords;
+        static Word largeObjectGCWords;
+        static std::vector<Word> largeObjects;
+        static std::map<Word, Word> freeLargeObjectRanges;
+        static std::mutex referenceLock;
+        static std::vector<ObjectPointer> weakObjects;
+        static std::vector<ObjectPointer> ephemerons;
+        static bool weakReferencesCleared;
+        static std::vector<ObjectPointer> finalizationRegistry;
+        static std::deque<ObjectPointer> finalizationQueue;
+        static bool finalizersQueued;
+        static std::vector<ObjectPointer> externalBuffers;
+        static std::deque<std::vector<SendSite>> sendSiteTables;
+        static std::vector<std::pair<Word, AllocationSite*>> sampledAllocations;
+        static Word softLimitWords;
+        static Word hardLimitWords;
+        static bool lowSpaceArmed;
+        static bool lowSpaceRequested;
+        static bool lowSpaceDetected;
+        static int64_t wordsUntilProfiled;
+        static Word profilingIntervalWords;
+        static std::function<void(ObjectPointer, Word)> allocationProfiler;
+        static GCLog gcLog;
+        static Word lastPromotedWords;
 
-        SmallInteger gcDurationMicros;
-        SmallInteger gcCounter;
+        static constexpr char STATE_ORIGINAL = 0;
+        static constexpr char STATE_FORWARDED = 1;
+        static constexpr char STATE_MARKED = 2;
 
+        /**
+         * Determines how many fields ahead the marker prefetches the headers of referenced objects.
+         */
+        static constexpr Word PREFETCH_DISTANCE = 4;
 
-        static constexpr char STATE_ORIGINAL = 0;
-        static constexpr char STATE_PARTIALLY_MOVED = 1;
-        static constexpr char STATE_FULLY_MOVED = 2;
-        static constexpr char STATE_ROOT = 3;
+        /**
+         * Determines how many fields an incremental marking step scans between two checks of its budget. Larger
+         * objects are scanned in chunks of this size.
+         */
+        static constexpr Word MARKING_CHUNK_FIELDS = 256;
+
+        static constexpr Word NO_MARKING_STEP = ~static_cast<Word>(0);
+
+        static constexpr Word PAGE_WORDS = 4096 / sizeof(Word);
+
+        static constexpr Word HEADER_SIZE = ObjectPointer::HEADER_SIZE;
+
+        /**
+         * Contains the number of sampled objects after which an allocation site is (re)evaluated.
+         */
+        static constexpr uint32_t PRETENURING_SAMPLES = 64;
+
+        /**
+         * Contains the percentage of sampled objects which have to survive their first scavenge so that their
+         * allocation site is pretenured.
+         */
+        static constexpr uint32_t PRETENURING_SURVIVAL_PERCENT = 90;
+
+        /**
+         * A pretenured site still places every n-th object in the nursery, so that it is pretenured no longer once its
+         * objects start to die young.
+         */
+        static constexpr uint32_t PRETENURING_PROBE_INTERVAL = 16;
+
+        /**
+         * Contains the granularity (in words) in which the heap is committed. This matches the size of a huge page.
+         */
+        static constexpr Word COMMIT_WORDS = (2 * 1024 * 1024) / sizeof(Word);
+
+        /**
+         * Contains the minimal number of words the old space may grow before a full collection is triggered.
+         */
+        static constexpr Word MINIMAL_OLD_SPACE_GROWTH = 1 << 22;
+
+        /**
+         * A segment is only evacuated if less than this percentage of its words is live. Therefore the segments of
+         * a mostly stable heap are never copied.
+         */
+        static constexpr Word EVACUATION_LIVE_PERCENT = 75;
+
+        /**
+         * Limits the number of live words which are copied by a single full collection. Segments exceeding this
+         * budget are left to one of the next collections.
+         */
+        static constexpr Word EVACUATION_BUDGET = 16 * Allocator::SEGMENT_SIZE;
+
+        static void* reserve(Word numberOfBytes, int protection = 0);
+
+        /**
+         * Contains the size of the virtual address range (in words) which is reserved for large objects.
+         */
+        static constexpr Word LARGE_OBJECT_SPACE_SIZE = 1 << 27;
+
+        static void commit(Word index, Word numberOfWords);
+
+        static void decommit(Word index, Word numberOfWords);
+
+        static void takeSegment();
+
+        static void checkSoftLimit();
+
+        static void restoreImage(ImageReader& image);
+
+        static std::vector<ObjectPointer> imageRootObjects;
+
+        /**
+         * Returns the number of words which are committed for the old space and the large object space.
+         */
+        static Word heapWords() {
+            return oldSpace.committedWords() + largeObjectWords;
+        }
+
+        /**
+         * Returns the number of words occupied by objects (dead or alive) in the nursery, the old space and the
+         * large object space.
+         */
+        static Word occupiedWords() {
+            return (nurseryAllocationIndex - nurseryStartIndex) + oldSpace.usedWords() + largeObjectWords;
+        }
+
+        void recordCollection(CollectionKind kind, std::chrono::steady_clock::time_point start, Word wordsBefore);
+
+        Word allocateInOldSpace(Word numberOfWords);
+
+        Word allocateDirtyInOldSpace(Word numberOfWords);
+
+        void awaitZeroedNursery(Word index);
+
+        void recordObjectStart(Word index, Word numberOfWords);
+
+        Word allocateLargeObject(Word numberOfWords);
+
+        void releaseLargeObject(Word index, Word numberOfWords);
+
+        void sweepLargeObjects();
+
+        void sweepExternalBuffers(bool markingCompleted);
+
+        bool shouldPretenure(AllocationSite& site);
+
+        void sampleAllocation(ObjectPointer obj, AllocationSite& site);
+
+        void updateAllocationSites();
+
+        ObjectPointer makeOldObject(SmallInteger numberOfFields, ObjectPointer type);
+
+        ObjectPointer allocateBuffer(SmallInteger numberOfBytes, ObjectPointer type, bool pretenure);
+
+        void scavengeCard(Word card, Word firstObject, Word limit);
+
+        void profileAllocation(ObjectPointer obj);
+
+        /**
+         * Accounts the given fresh object and reports it to the allocationProfiler once the next sample is due.
+         */
+        inline ObjectPointer profiled(ObjectPointer obj, Word numberOfWords) {
+            if ((wordsUntilProfiled -= numberOfWords) < 0) {
+                profileAllocation(obj);
+            }
+
+            return obj;
+        }
+
+        /**
+         * Invokes the given callback with the index of each object in the heap, including dead ones which haven't
+         * been reclaimed yet. Fillers are skipped. As only the raw headers are inspected, even large heaps are
+         * walked quickly. The callback must not allocate.
+         */
+        template<typename C>
+        void forEachObject(C callback) {
+            forEachObjectIn(1, rootAllocationIndex, callback);
+            forEachObjectIn(nurseryStartIndex, nurseryAllocationIndex, callback);
+            for (size_t index = 0; index < oldSpace.usedSegmentLimit(); index++) {
+                Segment& segment = oldSpace.segment(index);
+                if (segment.inUse()) {
+                    forEachObjectIn(segment.startIndex(), segment.topIndex(), callback);
+                }
+            }
+
+            for (Word index : largeObjects) {
+                callback(index);
+            }
+        }
+
+        template<typename P>
+        std::vector<ObjectPointer> findObjects(P predicate);
+
+        template<typename C>
+        void forEachObjectIn(Word start, Word end, C& callback) {
+            for (Word index = start; index < end;) {
+                uint32_t header = reinterpret_cast<ObjectPointer::Object*>(basePointer + index)->size;
+                if ((header >> ObjectPointer::FLAGS_SHIFT & ObjectPointer::ODD_MASK) != ObjectPointer::FORMAT_FILLER) {
+                    callback(index);
+                }
+                index += (header & ObjectPointer::SIZE_MASK) + HEADER_SIZE;
+            }
+        }
+
+        ObjectPointer forward(ObjectPointer obj);
+
+        Word scavengeObject(Word index);
+
+        void scavenge();
+
+        /**
+         * Determines if the given object is subject to the current marking, as only old objects which existed
+         * when the marking started and large objects are ever reclaimed.
+         */
+        inline bool isMarkable(ObjectPointer obj) const {
+            return (isOld(obj) && obj.index() < oldSpace.segmentOf(obj.index()).markingLimitIndex()) || isLarge(obj);
+        }
+
+        inline bool isUnmarked(ObjectPointer obj) const {
+            if (!isMarkable(obj)) {
+                return false;
+            }
+
+            uint32_t header = __atomic_load_n(&obj.pointer()->size, __ATOMIC_RELAXED);
+            return ((header >> ObjectPointer::FLAGS_SHIFT & ObjectPointer::GC_MASK) >> 4) != STATE_MARKED;
+        }
+
+        void mark(ObjectPointer obj, MarkStack& markStack);
+
+        bool deferWeakFields(ObjectPointer obj);
+
+        void traceEphemerons();
+
+        void queueFinalizers();
+
+        void clearWeakReferences();
 
-        void gc();
+        Word markFields(Word index, MarkStack& markStack);
 
-        ObjectPointer copyObject(ObjectPointer obj, std::deque<ObjectPointer>& gcWork);
+        bool markFields(ObjectPointer obj, Word from, Word limit, MarkStack& markStack);
 
-        ObjectPointer copyBuffer(ObjectPointer buffer, std::deque<ObjectPointer>& gcWork);
+        void markRemainingFields(const MarkStack::Entry& entry, MarkStack& markStack);
 
-        void translateObject(ObjectPointer obj, std::deque<ObjectPointer>& gcWork);
+        void drainMarkStacks(size_t worker, std::vector<MarkStack>& markStacks, std::atomic<size_t>& idleMarkers);
+
+        void startMarking();
+
+        void finishMarking();
+
+        inline bool survives(Word index, ObjectPointer obj) const {
+            return index >= oldSpace.segmentOf(index).markingLimitIndex() || obj.gcInfo() == STATE_MARKED;
+        }
+
+        ObjectPointer relocated(ObjectPointer obj);
+
+        Word relocateFields(Word index);
+
+        void selectEvacuationSet();
+
+        void evacuate();
+
+        void fullGC();
+
+        static void updateCollectionThresholds();
 
-        ObjectPointer translateField(ObjectPointer field, std::deque<ObjectPointer>& gcWork);
-*/
     public:
+        /**
+         * Contains the size of the nursery in words. As each send allocates a context of
+         * System::CONTEXT_SIZE fields, this permits about 30k sends between two scavenges.
+         */
+        static constexpr Word NURSERY_SIZE = 1 << 20;
 
-        static void initialize(std::string imageFileName);
+        /**
+         * Determines how many words can be allocated in the nursery between two incremental marking steps.
+         */
+        static constexpr Word MARKING_STEP_WORDS = NURSERY_SIZE / 16;
 
-   //     bool shouldIdleGC();
+        /**
+         * Determines how many words have to be allocated in the nursery so that a scavenge is performed once the
+         * interpreter is idle. Most of these objects are expected to be dead once a burst of work is completed.
+         */
+        static constexpr Word IDLE_GC_NURSERY_WORDS = NURSERY_SIZE / 8;
 
-    //    void idleGC();
+        /**
+         * Objects of at least this size (in words, including their header) are placed in the large object space.
+         */
+        static constexpr Word LARGE_OBJECT_THRESHOLD = 1 << 15;
+
+        /**
+         * Contains the maximal number of fields (or words of a buffer) an object can have. The highest byte
+         * of the 32 bit size header is used to store the GC state and the odd bytes of a buffer.
+         */
+        static constexpr Word MAX_OBJECT_SIZE = ObjectPointer::SIZE_MASK;
+
+        /**
+         * Contains the default maximal heap size in words (2 GB).
+         */
+        static constexpr Word DEFAULT_HEAP_SIZE = 1 << 28;
+
+        /**
+         * Represents a hard limit which is only bounded by the reserved address space.
+         */
+        static constexpr Word NO_HEAP_LIMIT = ~static_cast<Word>(0);
+
+        /**
+         * Reserves the address space for a heap of the given maximal size (in words). Memory is only committed
+         * as the old space grows. If an image file is given, the heap is restored from it (see saveImage) and has
+         * the size recorded in the image.
+         */
+        static void initialize(std::string imageFileName, Word maximumHeapSize = DEFAULT_HEAP_SIZE,
+                               HugePages pageMode = HugePages::NONE);
+
+        void registerRoot(ObjectPointer& root);
+
+        void unregisterRoot(ObjectPointer& root);
 
         bool shouldRunRecommendedGC() {
-            return false;
+            return nurseryAllocationIndex >= nurseryGCIndex || oldSpace.usedWords() >= oldSpaceGCWords ||
+                   markingComplete || largeObjectWords >= largeObjectGCWords || lowSpaceRequested;
+        }
+
+        void runRecommendedGC();
+
+        /**
+         * Determines if the given object resides in the nursery.
+         */
+        inline bool isYoung(ObjectPointer obj) const {
+            if (!obj.isObject() && !obj.isBuffer()) {
+                return false;
+            }
+
+            Word index = obj.index();
+            return index >= nurseryStartIndex && index < nurseryEndIndex;
+        }
+
+        /**
+         * Determines if the given object resides in a segment of the old space.
+         */
+        inline bool isOld(ObjectPointer obj) const {
+            if (!obj.isObject() && !obj.isBuffer()) {
+                return false;
+            }
+
+            Word index = obj.index();
+            return index >= oldSpaceStartIndex && index < oldSpaceEndIndex;
+        }
+
+        /**
+         * Determines if the given object resides in the large object space.
+         */
+        inline bool isLarge(ObjectPointer obj) const {
+            if (!obj.isObject() && !obj.isBuffer()) {
+                return false;
+            }
+
+            Word index = obj.index();
+            return index >= largeObjectStartIndex && index < largeObjectAllocationIndex;
+        }
+
+        /**
+         * Performs a full collection right away, regardless of the collection thresholds. Just like
+         * runRecommendedGC, this must only be invoked at a safepoint.
+         */
+        void runFullGC();
+
+        /**
+         * Determines if an incremental marking is in progress and enough has been allocated since its last step.
+         */
+        bool shouldPerformMarkingStep() {
+            return nurseryAllocationIndex >= nextMarkingStepIndex;
+        }
+
+        /**
+         * Marks gray objects until either all are processed or the given budget (markingStepMicros by default) would
+         * be exceeded by the next chunk of work. As no object is moved, this can be invoked from anywhere within the
+         * interpreter loop.
+         */
+        void performMarkingStep() {
+            performMarkingStep(markingStepMicros);
+        }
+
+        void performMarkingStep(SmallInteger budgetMicros);
+
+        /**
+         * Determines if there is enough work to be done while the interpreter is idle (see idleGC).
+         */
+        bool shouldIdleGC() const {
+            return markingActive || nurseryAllocationIndex - nurseryStartIndex >= IDLE_GC_NURSERY_WORDS;
         }
 
-        void runRecommendedGC() {
+        /**
+         * Uses the given idle time to either perform an incremental marking step or to run the recommended GC, which
+         * will complete a finished marking. Returns true if objects have been moved.
+         */
+        bool idleGC(SmallInteger budgetMicros);
+
+        /**
+         * Specifies the maximal duration of an incremental marking step in microseconds.
+         */
+        static void setMarkingStepBudget(SmallInteger micros) {
+            markingStepMicros = micros;
+        }
+
+        /**
+         * Specifies the soft and hard limit of the committed heap in words. By default, the soft limit is at three
+         * quarters of the maximal heap size and there is no hard limit.
+         */
+        static void setHeapLimits(Word softLimit, Word hardLimit);
+
+        /**
+         * Determines if the last collection was caused by crossing the soft limit and failed to get back below it.
+         * This is only reported once, until a full collection ends up below the soft limit again.
+         */
+        bool hasLowSpace() const {
+            return lowSpaceDetected;
+        }
+
+        /**
+         * Determines if an incremental marking is in progress, which prevents saveImage.
+         */
+        bool isMarking() const {
+            return markingActive;
+        }
+
+        /**
+         * Installs a profiler which is invoked for about every n-th allocated byte (as given by intervalBytes) along
+         * with the number of bytes the sample represents. The profiler must neither allocate nor trigger a
+         * collection. An interval of 0 uninstalls the profiler.
+         */
+        static void profileAllocations(Word intervalBytes, std::function<void(ObjectPointer, Word)> profiler);
+
+        /**
+         * Appends a line per collection to the given file.
+         */
+        static void logCollections(const std::string& fileName) {
+            gcLog.open(fileName);
+        }
+
+        /**
+         * Provides the number of collections and their recent pause times (see GCLog::counter).
+         */
+        const GCLog& gcStatistics() const {
+            return gcLog;
         }
 
         ObjectPointer makeRootObject(SmallInteger numberOfFields, ObjectPointer type);
 
+        ObjectPointer makeLargeObject(SmallInteger numberOfFields, ObjectPointer type);
+
         inline ObjectPointer makeObject(SmallInteger numberOfFields, ObjectPointer type) {
             if (numberOfFields < 0) {
                 throw std::runtime_error("Cannot allocate negative memory.");
             }
 
-            if (allocationIndex + numberOfFields + 2 < endIndex) {
-                Word result = allocationIndex;
-                allocationIndex += numberOfFields + 2;
-                return {result, type, numberOfFields};
-            } else {
-                throw std::runtime_error("Running out of memory!");
+            if (static_cast<Word>(numberOfFields) + HEADER_SIZE >= LARGE_OBJECT_THRESHOLD) {
+                return makeLargeObject(numberOfFields, type);
             }
+
+            if (nurseryAllocationIndex + numberOfFields + HEADER_SIZE < nurseryEndIndex) {
+                Word result = nurseryAllocationIndex;
+                nurseryAllocationIndex += numberOfFields + HEADER_SIZE;
+                if (nurseryAllocationIndex > nurseryZeroedIndex) {
+                    awaitZeroedNursery(nurseryAllocationIndex);
+                }
+                return profiled({result, type, numberOfFields}, numberOfFields + HEADER_SIZE);
+            }
+
+            // The nursery is exhausted (or the object is too large anyway) - as we must not collect outside of
+            // a safepoint, we directly allocate the object in the old space...
+            return profiled({allocateDirtyInOldSpace(numberOfFields + HEADER_SIZE), type, numberOfFields},
+                            numberOfFields + HEADER_SIZE);
         }
 
-        ObjectPointer makeBuffer(SmallInteger numberOfBytes, ObjectPointer type);
+        /**
+         * Creates a table of SendSites for a method with the given number of byte codes and returns its id, which
+         * is stored in the method by the caller. As methods are hardly ever collected, tables are kept as long as
+         * the VM runs and are stored in images.
+         */
+        uint32_t makeSendSiteTable(Word numberOfByteCodes);
+
+        SendSite& sendSite(uint32_t table, SmallInteger ip) {
+            return sendSiteTables[table].at(static_cast<size_t>(ip));
+        }
+
+        /**
+         * Allocates an object on behalf of the given site, which is either placed in the nursery or, if the site is
+         * pretenured, directly in the old space.
+         */
+        ObjectPointer makeObject(SmallInteger numberOfFields, ObjectPointer type, AllocationSite* site);
+
+        ObjectPointer makeWeakObject(SmallInteger numberOfFields, ObjectPointer type, AllocationSite* site = nullptr);
 
-        ObjectPointer makeString(std::string_view string, ObjectPointer type);
+        ObjectPointer makeEphemeron(SmallInteger numberOfFields, ObjectPointer type);
+
+        /**
+         * Determines if the last collection reclaimed objects which were referenced by weak objects or ephemerons.
+         */
+        bool hasClearedWeakReferences() const {
+            return weakReferencesCleared;
+        }
+
+        /**
+         * Registers the given finalizer to be queued once the given object is no longer reachable. Note that the
+         * finalizer itself is kept alive until it has been fetched via nextFinalizer.
+         */
+        void registerFinalizer(ObjectPointer obj, ObjectPointer finalizer);
+
+        /**
+         * Removes and returns the oldest queued finalizer or nil if there is none.
+         */
+        ObjectPointer nextFinalizer();
+
+        /**
+         * Determines if the last collection queued any finalizers.
+         */
+        bool hasQueuedFinalizers() const {
+            return finalizersQueued;
+        }
+
+        ObjectPointer makeBuffer(SmallInteger numberOfBytes, ObjectPointer type, AllocationSite* site = nullptr);
+
+        ObjectPointer makeString(std::string_view string, ObjectPointer type, AllocationSite* site = nullptr);
+
+        /**
+         * Creates a buffer which bytes are allocated outside of the heap. These are page aligned, zeroed and remain
+         * at their address until the buffer is collected.
+         */
+        ObjectPointer makeExternalBuffer(SmallInteger numberOfBytes, ObjectPointer type);
+
+        /**
+         * Counts the instances and bytes per class by walking the whole heap. The result is indexed by the class
+         * index (see ObjectPointer::classTable). Objects which are dead but not yet collected are also counted.
+         * The bytes of an external buffer include its external memory.
+         */
+        std::vector<ClassCensus> census();
+
+        /**
+         * Streams all objects, their references and all roots into the given output (see HeapDump). The name of each
+         * class is determined by the given function. Nothing is allocated within the heap, therefore this can be
+         * invoked from anywhere outside of a collection.
+         */
+        void writeHeapDump(std::ostream& out, const std::function<std::string_view(ObjectPointer)>& className);
+
+        /**
+         * Walks the whole heap and returns all instances of the given type. Objects which are dead but not yet
+         * collected are also reported (and therefore resurrected).
+         */
+        std::vector<ObjectPointer> allInstancesOf(ObjectPointer type);
+
+        /**
+         * Walks the whole heap and returns all objects which have a field pointing to the given object. Just like
+         * allInstancesOf, this also reports objects which are dead but not yet collected.
+         */
+        std::vector<ObjectPointer> allReferencesTo(ObjectPointer target);
+
+        /**
+         * Writes the whole heap along with the given roots into an image file. Each region (the root region and the
+         * nursery, each segment in use and each large object) is stored page aligned, so that initialize can map it
+         * copy-on-write right into the heap. The bytes of external buffers are copied. An image cannot be saved
+         * while a marking is in progress, as the mark bits would be stored in the objects.
+         */
+        void saveImage(const std::string& fileName, const std::vector<ObjectPointer>& imageRoots);
+
+        /**
+         * Records the layout of an image (see saveImage) into the given writer, without writing anything yet. The
+         * writer references the heap, which must therefore not change until the image has been written.
+         */
+        void prepareImage(ImageWriter& image, const std::vector<ObjectPointer>& imageRoots);
+
+        /**
+         * Writes an image (see saveImage) in a forked child process, which exits with 0 once it has written the
+         * image completely. The image is prepared before forking, so that the child only has to open and write the
+         * file. Returns the pid of the child, or -1 if it couldn't be forked.
+         */
+        pid_t forkImageWriter(const std::string& fileName, const std::vector<ObjectPointer>& imageRoots);
+
+        /**
+         * Returns the roots which have been stored in the image loaded by initialize. These have to be registered
+         * as roots (e.g. by System) before the first collection.
+         */
+        static const std::vector<ObjectPointer>& imageRoots() {
+            return imageRootObjects;
+        }
 
     };
 
@@ -5,46 +5,132 @@
 #ifndef PIMII_SEGMENT_H
 #define PIMII_SEGMENT_H
 
-#include <memory>
 #include "../common/types.h"
 
 namespace pimii {
 
+    /**
+     * Describes a fixed-size region of the old space (see Allocator). Objects are bump allocated between its start
+     * and its top. During a full collection, the marker accounts the live words of each segment so that only the
+     * segments containing the most garbage need to be evacuated.
+     */
     class Segment {
-        Word* basePointer;
-        Word* allocationPointer;
-        Word* endPointer;
-        SmallInteger size;
-        std::shared_ptr<Segment> previous;
+        Word start;
+        Word top;
+        Word end;
+        Word markingLimit;
+        Word live;
+        size_t successor;
+        bool used;
+        bool evacuating;
+
     public:
-        explicit Segment(SmallInteger sizeOfPool, std::shared_ptr<Segment> previous) : size(sizeOfPool),
-                                                                               previous(std::move(previous)) {
-            basePointer = (Word*) calloc(size, sizeof(Word));
-            endPointer = basePointer + size;
-            allocationPointer = basePointer;
-            memset(allocationPointer, 0, (endPointer - allocationPointer) * sizeof(Word));
+        static constexpr size_t NONE = ~static_cast<size_t>(0);
+
+        Segment(Word startIndex, Word endIndex) : start(startIndex), top(startIndex), end(endIndex),
+                                                  markingLimit(startIndex), live(0), successor(NONE), used(false),
+                                                  evacuating(false) {}
+
+        Word startIndex() const {
+            return start;
+        }
+
+        Word topIndex() const {
+            return top;
+        }
+
+        Word endIndex() const {
+            return end;
         }
 
-        ~Segment() {
-            free(basePointer);
+        /**
+         * Returns the number of words occupied by objects (dead or alive).
+         */
+        Word usedWords() const {
+            return top - start;
         }
 
-        SmallInteger sizeInWords() {
-            return size;
+        bool inUse() const {
+            return used;
         }
 
-        Word* alloc(SmallInteger numberOfWords) {
-            if (allocationPointer + numberOfWords < endPointer) {
-                Word* result = allocationPointer;
-                allocationPointer += numberOfWords;
-                return result;
-            } else {
-                return nullptr;
+        /**
+         * Returns the index of the segment which has been taken by the Allocator right after this one.
+         */
+        size_t successorSegment() const {
+            return successor;
+        }
+
+        void successorSegment(size_t segment) {
+            successor = segment;
+        }
+
+        Word alloc(Word numberOfWords) {
+            if (top + numberOfWords > end) {
+                return 0;
             }
+
+            Word result = top;
+            top += numberOfWords;
+            return result;
+        }
+
+        /**
+         * Objects at or above the marking limit have been allocated after the current marking started and are
+         * therefore implicitly live.
+         */
+        Word markingLimitIndex() const {
+            return markingLimit;
+        }
+
+        void startMarking() {
+            markingLimit = top;
+            live = 0;
+        }
+
+        /**
+         * Records a marked object. As several markers run in parallel, this is performed atomically.
+         */
+        void addLiveWords(Word numberOfWords) {
+            __atomic_fetch_add(&live, numberOfWords, __ATOMIC_RELAXED);
+        }
+
+        /**
+         * Returns the number of live words as determined by the last marking, including all words allocated since.
+         */
+        Word liveWords() const {
+            return live + (top - markingLimit);
+        }
+
+        bool isEvacuating() const {
+            return evacuating;
+        }
+
+        void evacuate() {
+            evacuating = true;
+        }
+
+        void take() {
+            used = true;
+            successor = NONE;
+        }
+
+        /**
+         * Marks the segment as taken and filled up to the given top, as recorded in an image.
+         */
+        void restore(Word topIndex, size_t successorSegment) {
+            take();
+            top = topIndex;
+            successor = successorSegment;
         }
 
-        const std::shared_ptr<Segment>& previousSegment() {
-            return previous;
+        void release() {
+            top = start;
+            markingLimit = start;
+            live = 0;
+            successor = NONE;
+            used = false;
+            evacuating = false;
         }
 
     };
@@ -0,0 +1,166 @@
+#ifndef PIMII_ZEROER_H
+#define PIMII_ZEROER_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "../common/types.h"
+
+namespace pimii {
+
+    /**
+     * Zero-fills a range of the heap on a background thread. The range is processed in chunks of CHUNK_SIZE words
+     * from bottom to top and zeroedIndex reports the progress, so that the allocator can hand out memory as soon as
+     * it has been wiped.
+     */
+    class Zeroer {
+        Word* basePointer;
+        std::mutex lock;
+        std::condition_variable requested;
+        std::condition_variable parked;
+        std::atomic<Word> zeroed;
+        Word index;
+        Word endIndex;
+        Word limitIndex;
+        uint64_t generation;
+        std::thread worker;
+        bool stopping;
+        bool paused;
+        bool filling;
+
+        /**
+         * Uses non-temporal stores (if available), as the zeroed memory won't be touched by the interpreter thread
+         * for a while and would otherwise only evict its working set from the cache.
+         */
+        static void fill(Word* from, Word* to) {
+#ifdef __SSE2__
+            while (from < to && reinterpret_cast<uintptr_t>(from) % sizeof(__m128i) != 0) {
+                *from++ = 0;
+            }
+
+            __m128i zero = _mm_setzero_si128();
+            for (; from + sizeof(__m128i) / sizeof(Word) <= to; from += sizeof(__m128i) / sizeof(Word)) {
+                _mm_stream_si128(reinterpret_cast<__m128i*>(from), zero);
+            }
+            _mm_sfence();
+#endif
+            std::fill(from, to, 0);
+        }
+
+        void run() {
+            std::unique_lock<std::mutex> guard(lock);
+            while (true) {
+                requested.wait(guard, [this]() { return stopping || (!paused && index < endIndex); });
+                if (stopping) {
+                    return;
+                }
+
+                Word chunkStart = index;
+                Word chunkEnd = std::min(index + CHUNK_SIZE, endIndex);
+                uint64_t chunkGeneration = generation;
+                filling = true;
+                guard.unlock();
+                fill(basePointer + chunkStart, basePointer + chunkEnd);
+                guard.lock();
+                filling = false;
+                parked.notify_all();
+
+                // If a new range was requested in the meantime, we simply start over...
+                if (chunkGeneration == generation) {
+                    index = chunkEnd;
+                    zeroed.store(index < endIndex ? index : limitIndex, std::memory_order_release);
+                }
+            }
+        }
+
+    public:
+        /**
+         * Contains the number of words which are zeroed before the progress is reported.
+         */
+        static constexpr Word CHUNK_SIZE = 8192;
+
+        Zeroer() : basePointer(nullptr), zeroed(0), index(0), endIndex(0), limitIndex(0), generation(0),
+                   stopping(false), paused(false), filling(false) {}
+
+        /**
+         * Stops the background thread, as the condition variable it waits on must not be destroyed underneath it.
+         */
+        ~Zeroer() {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            requested.notify_one();
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+
+        Zeroer(const Zeroer&) = delete;
+
+        Zeroer& operator=(const Zeroer&) = delete;
+
+        /**
+         * Requests the given range to be zero-filled. Once completed, zeroedIndex reports the given limit, as the
+         * memory up to there is known to be zero already. A range which is still being processed is merged into
+         * the new one.
+         */
+        void zero(Word* base, Word start, Word end, Word limit) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (index < endIndex) {
+                end = std::max(end, endIndex);
+            }
+
+            basePointer = base;
+            index = start;
+            endIndex = end;
+            limitIndex = limit;
+            generation++;
+            zeroed.store(start < end ? start : limit, std::memory_order_release);
+
+            if (!worker.joinable()) {
+                worker = std::thread([this]() { run(); });
+            }
+            requested.notify_one();
+        }
+
+        /**
+         * Parks the background thread between two chunks and blocks until it neither fills memory nor holds the
+         * lock. This is required before forking, as the child must neither see a half written chunk nor inherit a
+         * locked mutex.
+         */
+        void pause() {
+            std::unique_lock<std::mutex> guard(lock);
+            paused = true;
+            parked.wait(guard, [this]() { return !filling; });
+        }
+
+        /**
+         * Lets the background thread continue after pause.
+         */
+        void resume() {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                paused = false;
+            }
+            requested.notify_one();
+        }
+
+        /**
+         * Returns the index up to which the requested range has been zero-filled.
+         */
+        Word zeroedIndex() const {
+            return zeroed.load(std::memory_order_acquire);
+        }
+    };
+
+}
+
+#endif //PIMII_ZEROER_H
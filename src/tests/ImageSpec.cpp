@@ -0,0 +1,94 @@
+#include "catch.hpp"
+#include "TestSystem.h"
+
+#include <cstdlib>
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+namespace pimii {
+
+    static const char* const LOAD_IMAGE_TEST = "A saved image can be loaded by a fresh VM";
+
+    TEST_CASE("A bootstrapped system survives a round trip through an image", "[image]") {
+        System& sys = testSystem();
+        MemoryManager& mm = sys.memoryManager();
+
+        // Stores a large object, an external buffer and a queued (but not yet fetched) finalizer...
+        ObjectPointer keep = mm.makeObject(2, sys.typeArray());
+        sys.systemDictionary().atPut(sys.symbolTable().lookup("ImageSpecKeep"), keep);
+        ObjectPointer large = mm.makeObject(MemoryManager::LARGE_OBJECT_THRESHOLD, sys.typeArray());
+        large[0] = ObjectPointer::forSmallInt(42);
+        keep.store(0, large);
+        ObjectPointer buffer = mm.makeExternalBuffer(16, sys.typeByteArray());
+        buffer.storeByte(0, 'p');
+        buffer.storeByte(15, 'i');
+        keep.store(1, buffer);
+        mm.registerFinalizer(mm.makeObject(1, Nil::NIL), mm.makeString("finalized", sys.typeString()));
+        mm.runFullGC();
+        REQUIRE(mm.hasQueuedFinalizers());
+
+        char fileName[] = "/tmp/pimii-tests-XXXXXX";
+        int fd = mkstemp(fileName);
+        REQUIRE(fd >= 0);
+        close(fd);
+        mm.saveImage(fileName, sys.imageRoots());
+
+        // The MemoryManager can only be initialized once per process, therefore the image is loaded by another one...
+        setenv("PIMII_TEST_IMAGE", fileName, 1);
+        char* arguments[] = {const_cast<char*>("/proc/self/exe"), const_cast<char*>(LOAD_IMAGE_TEST), nullptr};
+        pid_t pid;
+        int status = -1;
+        REQUIRE(posix_spawn(&pid, arguments[0], nullptr, nullptr, arguments, environ) == 0);
+        REQUIRE(waitpid(pid, &status, 0) == pid);
+        unlink(fileName);
+
+        REQUIRE(WIFEXITED(status));
+        REQUIRE(WEXITSTATUS(status) == 0);
+    }
+
+    TEST_CASE("A snapshot reports once its image has been written", "[image]") {
+        System& sys = testSystem();
+        char fileName[] = "/tmp/pimii-tests-XXXXXX";
+        int fd = mkstemp(fileName);
+        REQUIRE(fd >= 0);
+        close(fd);
+
+        ObjectPointer result = evaluate(sys, "System snapshot: '" + std::string(fileName) + "'");
+        bool readable = false;
+        try {
+            ImageReader image(fileName);
+            readable = true;
+        } catch (const std::runtime_error&) {
+        }
+        unlink(fileName);
+
+        REQUIRE(result == sys.valueTrue());
+        REQUIRE(readable);
+
+        // The forked writer fails, as the directory doesn't exist...
+        REQUIRE(evaluate(sys, "System snapshot: '/pimii-tests/missing/snapshot.image'") == sys.valueFalse());
+    }
+
+    TEST_CASE(LOAD_IMAGE_TEST, "[.]") {
+        const char* fileName = getenv("PIMII_TEST_IMAGE");
+        REQUIRE(fileName != nullptr);
+
+        MemoryManager::initialize(fileName);
+        System sys(MemoryManager::imageRoots());
+        MemoryManager& mm = sys.memoryManager();
+
+        ObjectPointer keep = sys.systemDictionary().getValue(sys.symbolTable().lookup("ImageSpecKeep"));
+        REQUIRE(keep[0].size() == MemoryManager::LARGE_OBJECT_THRESHOLD);
+        REQUIRE(keep[0][0].smallInt() == 42);
+        REQUIRE(keep[1].byteSize() == 16);
+        REQUIRE(keep[1].fetchByte(0) == 'p');
+        REQUIRE(keep[1].fetchByte(15) == 'i');
+        REQUIRE(mm.nextFinalizer().stringView() == "finalized");
+        REQUIRE(mm.nextFinalizer() == Nil::NIL);
+
+        REQUIRE(evaluate(sys, "((ImageSpecKeep at: 1) at: 1) + 8").smallInt() == 50);
+    }
+
+}
@@ -0,0 +1,453 @@
+#include "catch.hpp"
+#include <memory>
+#include "TestSystem.h"
+
+namespace pimii {
+
+    TEST_CASE("A scavenge promotes everything reachable from a registered root", "[gc][scavenge]") {
+        MemoryManager& mm = testHeap();
+        ObjectPointer type = makeTestType();
+        TestRoot head(mm.makeObject(2, type));
+        ObjectPointer tail = *head;
+        for (SmallInteger i = 1; i <= 100; i++) {
+            ObjectPointer next = mm.makeObject(2, type);
+            next[0] = ObjectPointer::forSmallInt(i);
+            tail[1] = next;
+            tail = next;
+        }
+        for (int i = 0; i < 1000; i++) {
+            mm.makeObject(2, type);
+        }
+        REQUIRE(mm.isYoung(*head));
+
+        mm.runRecommendedGC();
+
+        // The whole list has to be copied (Cheney scan), whereas the garbage remains in the nursery...
+        REQUIRE(mm.isOld(*head));
+        SmallInteger length = 0;
+        for (ObjectPointer obj = (*head)[1]; obj != Nil::NIL && mm.isOld(obj); obj = obj[1]) {
+            if (obj[0].smallInt() == length + 1) {
+                length++;
+            }
+        }
+        REQUIRE(length == 100);
+        REQUIRE(mm.allInstancesOf(type).size() == 101);
+    }
+
+    TEST_CASE("Objects referenced from the root region survive a scavenge", "[gc][scavenge]") {
+        MemoryManager& mm = testHeap();
+        ObjectPointer root = mm.makeRootObject(1, Nil::NIL);
+        ObjectPointer young = mm.makeObject(1, Nil::NIL);
+        young[0] = ObjectPointer::forSmallInt(42);
+        root[0] = young;
+
+        mm.runRecommendedGC();
+
+        REQUIRE(mm.isOld(root[0]));
+        REQUIRE(root[0][0].smallInt() == 42);
+        root[0] = Nil::NIL;
+    }
+
+    TEST_CASE("The registers of the interpreter are roots of a scavenge", "[gc][scavenge]") {
+        System& sys = testSystem();
+        MemoryManager& mm = sys.memoryManager();
+        std::vector<Error> errors;
+        Tokenizer tokenizer("nil", errors);
+        Compiler compiler(tokenizer, errors, sys.typeArray());
+        ObjectPointer method = compiler.compileExpression(sys);
+
+        ObjectPointer sender = mm.makeObject(System::CONTEXT_SIZE, sys.typeMethodContext());
+        sender[System::CONTEXT_IP_FIELD] = ObjectPointer::forSmallInt(0);
+        ObjectPointer context = mm.makeObject(System::CONTEXT_SIZE, sys.typeMethodContext());
+        context[System::CONTEXT_SENDER_FIELD] = sender;
+        context[System::CONTEXT_IP_FIELD] = ObjectPointer::forSmallInt(0);
+        context[System::CONTEXT_SP_FIELD] = ObjectPointer::forSmallInt(0);
+        context[System::CONTEXT_METHOD_FIELD] = method;
+        Interpreter interpreter(sys);
+        interpreter.newActiveContext(context);
+        REQUIRE(mm.isYoung(interpreter.currentActiveContext()));
+
+        mm.runRecommendedGC();
+
+        ObjectPointer activeContext = interpreter.currentActiveContext();
+        REQUIRE(mm.isOld(activeContext));
+        REQUIRE(mm.isOld(activeContext[System::CONTEXT_SENDER_FIELD]));
+        REQUIRE(activeContext[System::CONTEXT_METHOD_FIELD].type() == sys.typeCompiledMethod());
+    }
+
+    TEST_CASE("An old object which is stored into keeps its young value alive across a scavenge", "[gc][scavenge]") {
+        MemoryManager& mm = testHeap();
+        TestRoot old(mm.makeObject(2, Nil::NIL));
+        mm.runRecommendedGC();
+        // The second scavenge leaves the promoted object with clean cards...
+        mm.runRecommendedGC();
+        REQUIRE(mm.isOld(*old));
+
+        ObjectPointer young = mm.makeObject(1, Nil::NIL);
+        young[0] = ObjectPointer::forSmallInt(42);
+        (*old).store(1, young);
+        REQUIRE(mm.isYoung((*old)[1]));
+
+        mm.runRecommendedGC();
+
+        REQUIRE(mm.isOld((*old)[1]));
+        REQUIRE((*old)[1][0].smallInt() == 42);
+    }
+
+    TEST_CASE("A full GC evacuates sparse segments and updates all references", "[gc][evacuation]") {
+        MemoryManager& mm = testHeap();
+        ObjectPointer type = makeTestType();
+        const SmallInteger objectSize = 1000;
+        const auto numberOfObjects = static_cast<SmallInteger>(
+                3 * Allocator::SEGMENT_SIZE / (objectSize + ObjectPointer::HEADER_SIZE));
+        TestRoot holder(mm.makeObject(numberOfObjects, Nil::NIL));
+        for (SmallInteger i = 0; i < numberOfObjects; i++) {
+            ObjectPointer obj = mm.makeObject(objectSize, type);
+            obj[0] = ObjectPointer::forSmallInt(i);
+            (*holder).store(i, obj);
+            if (i % 100 == 99) {
+                mm.runRecommendedGC();
+            }
+        }
+        mm.runRecommendedGC();
+
+        // Only every tenth object survives, each one referencing the next survivor...
+        std::vector<ObjectPointer> locations;
+        for (SmallInteger i = 0; i < numberOfObjects; i++) {
+            if (i % 10 == 0) {
+                REQUIRE(mm.isOld((*holder)[i]));
+                locations.push_back((*holder)[i]);
+                if (i + 10 < numberOfObjects) {
+                    (*holder)[i].store(1, (*holder)[i + 10]);
+                }
+            } else {
+                (*holder).store(i, Nil::NIL);
+            }
+        }
+
+        mm.runFullGC();
+
+        bool moved = false;
+        for (SmallInteger i = 0; i < numberOfObjects; i += 10) {
+            ObjectPointer obj = (*holder)[i];
+            REQUIRE(obj[0].smallInt() == i);
+            if (i + 10 < numberOfObjects) {
+                REQUIRE(obj[1] == (*holder)[i + 10]);
+            }
+            moved |= obj != locations[static_cast<size_t>(i / 10)];
+        }
+        REQUIRE(moved);
+
+        // Neither the dead objects which became fillers nor the ones in the evacuated segments are found...
+        REQUIRE(mm.allInstancesOf(type).size() == locations.size());
+    }
+
+    TEST_CASE("Large objects are never moved and swept once dead", "[gc][large]") {
+        MemoryManager& mm = testHeap();
+        ObjectPointer type = makeTestType();
+        TestRoot weak(mm.makeWeakObject(1, Nil::NIL));
+        auto large = std::make_unique<TestRoot>(mm.makeObject(MemoryManager::LARGE_OBJECT_THRESHOLD, type));
+        ObjectPointer location = **large;
+        REQUIRE(mm.isLarge(location));
+        (*weak).store(0, location);
+        (**large)[0] = ObjectPointer::forSmallInt(42);
+        (**large).store(1, mm.makeObject(1, Nil::NIL));
+
+        mm.runRecommendedGC();
+        mm.runFullGC();
+
+        REQUIRE(**large == location);
+        REQUIRE((**large)[0].smallInt() == 42);
+        REQUIRE(mm.isOld((**large)[1]));
+
+        large.reset();
+        mm.runFullGC();
+
+        REQUIRE((*weak)[0] == Nil::NIL);
+        REQUIRE(mm.allInstancesOf(type).empty());
+    }
+
+    TEST_CASE("An allocation site is pretenured while its objects survive", "[gc][pretenuring]") {
+        MemoryManager& mm = testHeap();
+        AllocationSite site{};
+        TestRoot holder(mm.makeObject(64, Nil::NIL));
+        for (SmallInteger i = 0; i < 64; i++) {
+            (*holder).store(i, mm.makeObject(1, Nil::NIL, &site));
+        }
+        REQUIRE(!site.pretenured);
+
+        mm.runRecommendedGC();
+
+        // Every 16th object is still placed in the nursery to probe the site...
+        REQUIRE(site.pretenured);
+        int old = 0;
+        for (SmallInteger i = 0; i < 32; i++) {
+            ObjectPointer obj = mm.makeObject(1, Nil::NIL, &site);
+            (*holder).store(i, obj);
+            old += mm.isOld(obj) ? 1 : 0;
+        }
+        REQUIRE(old == 30);
+
+        // ...therefore it is no longer pretenured once these probes die...
+        for (SmallInteger i = 0; i < 64 * 16; i++) {
+            mm.makeObject(1, Nil::NIL, &site);
+        }
+        mm.runRecommendedGC();
+
+        REQUIRE(!site.pretenured);
+        REQUIRE(mm.isYoung(mm.makeObject(1, Nil::NIL, &site)));
+    }
+
+    TEST_CASE("Reused memory is handed out zeroed", "[gc][zeroing]") {
+        MemoryManager& mm = testHeap();
+        AllocationSite pretenured{0, 0, 0, true};
+        const SmallInteger objectSize = 1000;
+        const auto numberOfObjects = static_cast<SmallInteger>(
+                3 * Allocator::SEGMENT_SIZE / (objectSize + ObjectPointer::HEADER_SIZE));
+        auto fill = [&](AllocationSite* site) {
+            for (SmallInteger i = 0; i < numberOfObjects; i++) {
+                ObjectPointer obj = mm.makeObject(objectSize, Nil::NIL, site);
+                for (SmallInteger field = 0; field < objectSize; field++) {
+                    obj[field] = ObjectPointer::forSmallInt(field + 1);
+                }
+            }
+        };
+        auto allZeroed = [&](AllocationSite* site) {
+            for (SmallInteger i = 0; i < numberOfObjects; i++) {
+                ObjectPointer obj = mm.makeObject(objectSize, Nil::NIL, site);
+                for (SmallInteger field = 0; field < objectSize; field++) {
+                    if (obj[field] != Nil::NIL) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        };
+
+        // The nursery is reused after each scavenge...
+        mm.runRecommendedGC();
+        fill(nullptr);
+        mm.runRecommendedGC();
+        REQUIRE(allZeroed(nullptr));
+
+        // ...whereas the segments of the old space are reused once evacuated...
+        fill(&pretenured);
+        mm.runFullGC();
+        REQUIRE(allZeroed(&pretenured));
+
+        // Reclaims the garbage, so that it doesn't trigger collections in other tests...
+        mm.runFullGC();
+    }
+
+    TEST_CASE("Crossing the soft limit is reported once", "[gc][limits]") {
+        MemoryManager& mm = testHeap();
+        MemoryManager::setHeapLimits(1, MemoryManager::NO_HEAP_LIMIT);
+        TestRoot large(mm.makeObject(MemoryManager::LARGE_OBJECT_THRESHOLD, Nil::NIL));
+        REQUIRE(mm.shouldRunRecommendedGC());
+
+        mm.runRecommendedGC();
+        REQUIRE(mm.hasLowSpace());
+
+        // The soft limit is only checked again once a collection got below it...
+        mm.makeObject(MemoryManager::LARGE_OBJECT_THRESHOLD, Nil::NIL);
+        mm.runRecommendedGC();
+        REQUIRE(!mm.hasLowSpace());
+        mm.runFullGC();
+        REQUIRE(!mm.hasLowSpace());
+
+        MemoryManager::setHeapLimits(MemoryManager::DEFAULT_HEAP_SIZE / 4 * 3, MemoryManager::NO_HEAP_LIMIT);
+        mm.runFullGC();
+        REQUIRE(!mm.hasLowSpace());
+    }
+
+    TEST_CASE("Crossing the soft limit signals the LowSpaceSemaphore", "[gc][limits]") {
+        System& sys = testSystem();
+        ObjectPointer semaphore = sys.processor()[System::PROCESSOR_FIELD_LOW_SPACE_SEMAPHORE];
+        SmallInteger signals = semaphore[System::SEMAPHORE_FIELD_EXCESS_SIGNALS].smallInt();
+        MemoryManager::setHeapLimits(1, MemoryManager::NO_HEAP_LIMIT);
+
+        REQUIRE(evaluate(sys, "(Array new: 40000) size").smallInt() == 40000);
+
+        MemoryManager::setHeapLimits(MemoryManager::DEFAULT_HEAP_SIZE / 4 * 3, MemoryManager::NO_HEAP_LIMIT);
+        sys.memoryManager().runFullGC();
+        semaphore = sys.processor()[System::PROCESSOR_FIELD_LOW_SPACE_SEMAPHORE];
+        REQUIRE(semaphore[System::SEMAPHORE_FIELD_EXCESS_SIGNALS].smallInt() == signals + 1);
+    }
+
+    TEST_CASE("The GC log reports the percentiles of the recent pauses", "[gc][log]") {
+        GCLog log;
+        const SmallInteger full = static_cast<SmallInteger>(CollectionKind::FULL) * GCLog::COUNTERS_PER_KIND;
+        for (uint64_t pause = 100; pause > 0; pause--) {
+            log.record({CollectionKind::FULL, pause, 0, 0, 0, 0});
+        }
+
+        REQUIRE(log.counter(full + GCLog::COUNTER_COLLECTIONS) == 100);
+        REQUIRE(log.counter(full + GCLog::COUNTER_PAUSE_P50) == 50);
+        REQUIRE(log.counter(full + GCLog::COUNTER_PAUSE_P99) == 99);
+        REQUIRE(log.counter(full + GCLog::COUNTER_PAUSE_MAX) == 100);
+        REQUIRE(log.counter(GCLog::COUNTER_COLLECTIONS) == 0);
+        REQUIRE(log.counter(GCLog::COUNTER_PAUSE_MAX) == 0);
+
+        // Only the last WINDOW_SIZE pauses are considered...
+        for (size_t i = 0; i < GCLog::WINDOW_SIZE; i++) {
+            log.record({CollectionKind::FULL, 7, 0, 0, 0, 0});
+        }
+
+        REQUIRE(log.counter(full + GCLog::COUNTER_COLLECTIONS) == 100 + GCLog::WINDOW_SIZE);
+        REQUIRE(log.counter(full + GCLog::COUNTER_PAUSE_P99) == 7);
+        REQUIRE(log.counter(full + GCLog::COUNTER_PAUSE_MAX) == 7);
+    }
+
+    TEST_CASE("The counters of the GC log can be read via System readCounter:", "[gc][log]") {
+        System& sys = testSystem();
+        sys.memoryManager().runFullGC();
+        const SmallInteger fullCollections = static_cast<SmallInteger>(CollectionKind::FULL) * GCLog::COUNTERS_PER_KIND;
+
+        SmallInteger value = evaluate(sys, "System readCounter: " + std::to_string(fullCollections)).smallInt();
+
+        REQUIRE(value > 0);
+        REQUIRE(static_cast<uint64_t>(value) == sys.memoryManager().gcStatistics().counter(fullCollections));
+        REQUIRE(evaluate(sys, "System readCounter: -1").smallInt() == 0);
+    }
+
+    TEST_CASE("The heap can be searched for instances and references in all spaces", "[gc][heap]") {
+        MemoryManager& mm = testHeap();
+        ObjectPointer type = makeTestType();
+        TestRoot target(mm.makeObject(1, Nil::NIL));
+        TestRoot old(mm.makeObject(1, type));
+        (*old)[0] = *target;
+        mm.runRecommendedGC();
+        TestRoot large(mm.makeObject(MemoryManager::LARGE_OBJECT_THRESHOLD, type));
+        (*large).store(0, *target);
+        TestRoot young(mm.makeObject(1, type));
+        (*young)[0] = *target;
+        mm.makeObject(1, type);
+        REQUIRE(mm.isOld(*old));
+        REQUIRE(mm.isLarge(*large));
+        REQUIRE(mm.isYoung(*young));
+
+        // Objects which are dead but not yet collected are reported as well...
+        REQUIRE(mm.allInstancesOf(type).size() == 4);
+
+        mm.runFullGC();
+
+        std::vector<ObjectPointer> instances = mm.allInstancesOf(type);
+        REQUIRE(instances.size() == 3);
+        for (ObjectPointer obj : {*old, *large, *young}) {
+            REQUIRE(std::find(instances.begin(), instances.end(), obj) != instances.end());
+        }
+
+        std::vector<ObjectPointer> references = mm.allReferencesTo(*target);
+        REQUIRE(references.size() == 3);
+        for (ObjectPointer obj : {*old, *large, *young}) {
+            REQUIRE(std::find(references.begin(), references.end(), obj) != references.end());
+        }
+        REQUIRE(mm.allReferencesTo(Nil::NIL).empty());
+    }
+
+    TEST_CASE("A weak field is cleared once its value is collected", "[gc]") {
+        MemoryManager& mm = testHeap();
+        TestRoot weak(mm.makeWeakObject(3, Nil::NIL));
+        TestRoot strong(mm.makeObject(1, Nil::NIL));
+        (*weak)[0] = *strong;
+        (*weak)[1] = mm.makeObject(1, Nil::NIL);
+        (*weak)[2] = ObjectPointer::forSmallInt(42);
+
+        mm.runFullGC();
+
+        REQUIRE(mm.hasClearedWeakReferences());
+        REQUIRE((*weak)[0] == *strong);
+        REQUIRE((*weak)[1] == Nil::NIL);
+        REQUIRE((*weak)[2].smallInt() == 42);
+    }
+
+    TEST_CASE("The value of an ephemeron is only kept alive by its key", "[gc]") {
+        MemoryManager& mm = testHeap();
+        TestRoot ephemeron(mm.makeEphemeron(2, Nil::NIL));
+        auto key = std::make_unique<TestRoot>(mm.makeObject(1, Nil::NIL));
+        ObjectPointer value = mm.makeObject(1, Nil::NIL);
+        value[0] = ObjectPointer::forSmallInt(42);
+        (*ephemeron)[0] = **key;
+        (*ephemeron)[1] = value;
+
+        mm.runFullGC();
+
+        REQUIRE((*ephemeron)[0] == **key);
+        REQUIRE((*ephemeron)[1][0].smallInt() == 42);
+
+        key.reset();
+        mm.runFullGC();
+
+        REQUIRE(mm.hasClearedWeakReferences());
+        REQUIRE((*ephemeron)[0] == Nil::NIL);
+        REQUIRE((*ephemeron)[1] == Nil::NIL);
+    }
+
+    TEST_CASE("An ephemeron key which is only referenced by its value is collected", "[gc]") {
+        MemoryManager& mm = testHeap();
+        TestRoot ephemeron(mm.makeEphemeron(2, Nil::NIL));
+        ObjectPointer key = mm.makeObject(1, Nil::NIL);
+        ObjectPointer value = mm.makeObject(1, Nil::NIL);
+        value[0] = key;
+        (*ephemeron)[0] = key;
+        (*ephemeron)[1] = value;
+
+        mm.runFullGC();
+
+        REQUIRE(mm.hasClearedWeakReferences());
+        REQUIRE((*ephemeron)[0] == Nil::NIL);
+        REQUIRE((*ephemeron)[1] == Nil::NIL);
+    }
+
+    TEST_CASE("A finalizer is queued once after its object has been collected", "[gc]") {
+        MemoryManager& mm = testHeap();
+        auto obj = std::make_unique<TestRoot>(mm.makeObject(1, Nil::NIL));
+        ObjectPointer finalizer = mm.makeObject(1, Nil::NIL);
+        finalizer[0] = ObjectPointer::forSmallInt(42);
+        mm.registerFinalizer(**obj, finalizer);
+
+        mm.runFullGC();
+
+        REQUIRE_FALSE(mm.hasQueuedFinalizers());
+        REQUIRE(mm.nextFinalizer() == Nil::NIL);
+
+        obj.reset();
+        mm.runFullGC();
+
+        REQUIRE(mm.hasQueuedFinalizers());
+        REQUIRE(mm.nextFinalizer()[0].smallInt() == 42);
+        REQUIRE(mm.nextFinalizer() == Nil::NIL);
+
+        mm.runFullGC();
+
+        REQUIRE_FALSE(mm.hasQueuedFinalizers());
+        REQUIRE(mm.nextFinalizer() == Nil::NIL);
+    }
+
+    TEST_CASE("A finalizer which references its object doesn't resurrect it for good", "[gc]") {
+        MemoryManager& mm = testHeap();
+        TestRoot weak(mm.makeWeakObject(1, Nil::NIL));
+        ObjectPointer obj = mm.makeObject(1, Nil::NIL);
+        obj[0] = ObjectPointer::forSmallInt(42);
+        ObjectPointer finalizer = mm.makeObject(1, Nil::NIL);
+        finalizer[0] = obj;
+        (*weak)[0] = obj;
+        mm.registerFinalizer(obj, finalizer);
+
+        mm.runFullGC();
+
+        // The finalizer keeps its object alive until it has been fetched and run...
+        REQUIRE(mm.hasQueuedFinalizers());
+        auto queued = std::make_unique<TestRoot>(mm.nextFinalizer());
+        REQUIRE((**queued)[0][0].smallInt() == 42);
+        REQUIRE((*weak)[0] == (**queued)[0]);
+
+        queued.reset();
+        mm.runFullGC();
+
+        REQUIRE_FALSE(mm.hasQueuedFinalizers());
+        REQUIRE(mm.nextFinalizer() == Nil::NIL);
+        REQUIRE((*weak)[0] == Nil::NIL);
+    }
+
+}
@@ -0,0 +1,57 @@
+#ifndef PIMII_TESTHEAP_H
+#define PIMII_TESTHEAP_H
+
+#include "../mem/MemoryManager.h"
+
+namespace pimii {
+
+    /**
+     * Provides the heap shared by all tests. As the state of the MemoryManager is static, it is only initialized
+     * once per process and only when a test actually needs it.
+     */
+    inline MemoryManager& testHeap() {
+        static bool initialized = []() {
+            MemoryManager::initialize("");
+            return true;
+        }();
+        static MemoryManager mm;
+
+        (void) initialized;
+        return mm;
+    }
+
+    /**
+     * Creates a type of its own, so that a test can find all of its instances (e.g. via allInstancesOf). As a type
+     * is kept in the root region and registered in the classTable, it is never moved or collected.
+     */
+    inline ObjectPointer makeTestType() {
+        return testHeap().makeRootObject(ObjectPointer::TYPE_FIELD_CLASS_INDEX + 1, Nil::NIL);
+    }
+
+    /**
+     * Keeps an object alive and up to date across collections, as long as it is in scope.
+     */
+    class TestRoot {
+        ObjectPointer obj;
+
+    public:
+        explicit TestRoot(ObjectPointer obj) : obj(obj) {
+            testHeap().registerRoot(this->obj);
+        }
+
+        ~TestRoot() {
+            testHeap().unregisterRoot(obj);
+        }
+
+        TestRoot(const TestRoot&) = delete;
+
+        TestRoot& operator=(const TestRoot&) = delete;
+
+        ObjectPointer operator*() const {
+            return obj;
+        }
+    };
+
+}
+
+#endif //PIMII_TESTHEAP_H
@@ -0,0 +1,74 @@
+#ifndef PIMII_TESTSYSTEM_H
+#define PIMII_TESTSYSTEM_H
+
+#include <fstream>
+#include <string>
+
+#include "TestHeap.h"
+#include "../vm/Interpreter.h"
+#include "../compiler/Compiler.h"
+#include "../compiler/SourceFileParser.h"
+
+namespace pimii {
+
+    /**
+     * Provides a system which is bootstrapped from source.st (expected in the working directory) once per process.
+     */
+    inline System& testSystem() {
+        static bool bootstrapped = false;
+        testHeap();
+        static System sys;
+        if (!bootstrapped) {
+            bootstrapped = true;
+            std::ifstream source("source.st");
+            if (!source.good()) {
+                throw std::runtime_error("Cannot read source.st - run the tests from the root of the repository!");
+            }
+
+            std::string content((std::istreambuf_iterator<char>(source)), std::istreambuf_iterator<char>());
+            SourceFileParser parser(sys, content);
+            parser.compile();
+        }
+
+        return sys;
+    }
+
+    /**
+     * Compiles and runs the given statements in a fresh interpreter and returns the value of the last one. As the
+     * interpreter never returns by itself, the value is stored in the global TestResult, before the interpreter is
+     * stopped by an unknown message.
+     */
+    inline ObjectPointer evaluate(System& sys, const std::string& statements) {
+        sys.systemDictionary().atPut(sys.symbolTable().lookup("TestResult"),
+                                     sys.memoryManager().makeObject(1, sys.typeArray()));
+
+        std::vector<Error> errors;
+        std::string source = "TestResult at: 1 put: [ " + statements + " ] value. TestResult stopEvaluation.";
+        Tokenizer tokenizer(source, errors);
+        Compiler compiler(tokenizer, errors, sys.typeArray());
+        ObjectPointer method = compiler.compileExpression(sys);
+        if (!errors.empty()) {
+            throw std::runtime_error("Cannot compile: " + statements);
+        }
+
+        ObjectPointer context = sys.memoryManager().makeObject(System::CONTEXT_SIZE, Nil::NIL);
+        context[System::CONTEXT_IP_FIELD] = ObjectPointer::forSmallInt(0);
+        context[System::CONTEXT_SP_FIELD] = ObjectPointer::forSmallInt(0);
+        context[System::CONTEXT_METHOD_FIELD] = method;
+
+        Interpreter interpreter(sys);
+        try {
+            interpreter.run(context);
+        } catch (const std::exception& e) {
+            if (std::string(e.what()).find("stopEvaluation") == std::string::npos) {
+                throw;
+            }
+        }
+
+        // The interpreter might have moved all objects, therefore the result is looked up again...
+        return sys.systemDictionary().getValue(sys.symbolTable().lookup("TestResult"))[0];
+    }
+
+}
+
+#endif //PIMII_TESTSYSTEM_H
@@ -1,2 +1,4 @@
 #define CATCH_CONFIG_MAIN
+// The bundled Catch predates glibc 2.34, where SIGSTKSZ is no longer a constant...
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
 #include "catch.hpp"
@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../mem/HeapDump.h"
+
+/**
+ * Reads a heap dump written by MemoryManager::writeHeapDump and reports the objects which retain the most memory.
+ * The retained size of an object is the size of all objects which are only reachable through it. This is computed
+ * via the dominator tree of the object graph, whose single entry is a virtual root which references all roots.
+ */
+namespace {
+
+    constexpr uint32_t VIRTUAL_ROOT = 0;
+    constexpr uint32_t UNDEFINED = UINT32_MAX;
+
+    /**
+     * Contains the object graph, where the virtual root is node 0 and all objects are numbered in the order of
+     * the dump. The references of node i are stored in targets[offsets[i]] up to targets[offsets[i + 1]].
+     */
+    struct Graph {
+        std::vector<std::string> classNames;
+        std::vector<uint64_t> classIndices;
+        std::vector<uint64_t> shallowSizes;
+        std::vector<uint64_t> offsets;
+        std::vector<uint32_t> targets;
+    };
+
+    Graph read(std::istream& in) {
+        pimii::HeapDumpReader reader(in);
+        Graph graph;
+        std::unordered_map<uint64_t, uint32_t> nodes;
+        std::vector<uint64_t> roots;
+        std::vector<uint64_t> references;
+
+        graph.classIndices.push_back(0);
+        graph.shallowSizes.push_back(0);
+        graph.offsets.push_back(0);
+        while (true) {
+            uint8_t tag = reader.tag();
+            if (tag == pimii::HeapDump::TAG_END) {
+                break;
+            } else if (tag == pimii::HeapDump::TAG_CLASS) {
+                uint64_t index = reader.number();
+                if (graph.classNames.size() <= index) {
+                    graph.classNames.resize(index + 1, "?");
+                }
+                graph.classNames[index] = reader.string();
+            } else if (tag == pimii::HeapDump::TAG_ROOT) {
+                roots.push_back(reader.number());
+            } else if (tag == pimii::HeapDump::TAG_OBJECT) {
+                nodes[reader.number()] = static_cast<uint32_t>(graph.shallowSizes.size());
+                graph.classIndices.push_back(reader.number());
+                graph.shallowSizes.push_back(reader.number());
+                for (uint64_t count = reader.number(); count > 0; count--) {
+                    references.push_back(reader.number());
+                }
+                graph.offsets.push_back(references.size());
+            } else {
+                throw std::runtime_error("Invalid or truncated heap dump!");
+            }
+        }
+
+        // References to unknown objects (which cannot occur in a consistent dump) are dropped...
+        auto resolve = [&nodes](uint64_t id) {
+            auto node = nodes.find(id);
+            return node == nodes.end() ? UNDEFINED : node->second;
+        };
+
+        std::vector<uint32_t> rootNodes;
+        for (uint64_t root : roots) {
+            uint32_t node = resolve(root);
+            if (node != UNDEFINED) {
+                rootNodes.push_back(node);
+            }
+        }
+        std::sort(rootNodes.begin(), rootNodes.end());
+        rootNodes.erase(std::unique(rootNodes.begin(), rootNodes.end()), rootNodes.end());
+
+        graph.targets = rootNodes;
+        std::vector<uint64_t> offsets = std::move(graph.offsets);
+        graph.offsets.clear();
+        graph.offsets.push_back(0);
+        graph.offsets.push_back(rootNodes.size());
+        for (size_t node = 1; node < offsets.size(); node++) {
+            for (uint64_t index = offsets[node - 1]; index < offsets[node]; index++) {
+                uint32_t target = resolve(references[index]);
+                if (target != UNDEFINED) {
+                    graph.targets.push_back(target);
+                }
+            }
+            graph.offsets.push_back(graph.targets.size());
+        }
+
+        return graph;
+    }
+
+    /**
+     * Computes the post order number of each node reachable from the virtual root (UNDEFINED for all others) and
+     * returns the reachable nodes in reverse post order.
+     */
+    std::vector<uint32_t> reversePostOrder(const Graph& graph, std::vector<uint32_t>& postOrderNumbers) {
+        size_t numberOfNodes = graph.shallowSizes.size();
+        postOrderNumbers.assign(numberOfNodes, UNDEFINED);
+        std::vector<bool> visited(numberOfNodes, false);
+        std::vector<uint32_t> postOrder;
+        std::vector<std::pair<uint32_t, uint64_t>> stack;
+
+        visited[VIRTUAL_ROOT] = true;
+        stack.emplace_back(VIRTUAL_ROOT, graph.offsets[VIRTUAL_ROOT]);
+        while (!stack.empty()) {
+            auto& [node, next] = stack.back();
+            if (next < graph.offsets[node + 1]) {
+                uint32_t target = graph.targets[next++];
+                if (!visited[target]) {
+                    visited[target] = true;
+                    stack.emplace_back(target, graph.offsets[target]);
+                }
+            } else {
+                postOrderNumbers[node] = static_cast<uint32_t>(postOrder.size());
+                postOrder.push_back(node);
+                stack.pop_back();
+            }
+        }
+
+        std::reverse(postOrder.begin(), postOrder.end());
+        return postOrder;
+    }
+
+    /**
+     * Computes the immediate dominator of each reachable node using the iterative algorithm by Cooper, Harvey and
+     * Kennedy ("A Simple, Fast Dominance Algorithm").
+     */
+    std::vector<uint32_t> dominators(const Graph& graph, const std::vector<uint32_t>& order,
+                                     const std::vector<uint32_t>& postOrderNumbers) {
+        size_t numberOfNodes = graph.shallowSizes.size();
+        std::vector<uint64_t> predecessorOffsets(numberOfNodes + 1, 0);
+        for (uint32_t node : order) {
+            for (uint64_t index = graph.offsets[node]; index < graph.offsets[node + 1]; index++) {
+                predecessorOffsets[graph.targets[index] + 1]++;
+            }
+        }
+        for (size_t node = 0; node < numberOfNodes; node++) {
+            predecessorOffsets[node + 1] += predecessorOffsets[node];
+        }
+        std::vector<uint32_t> predecessors(predecessorOffsets[numberOfNodes]);
+        std::vector<uint64_t> fill(predecessorOffsets.begin(), predecessorOffsets.end() - 1);
+        for (uint32_t node : order) {
+            for (uint64_t index = graph.offsets[node]; index < graph.offsets[node + 1]; index++) {
+                predecessors[fill[graph.targets[index]]++] = node;
+            }
+        }
+
+        std::vector<uint32_t> idom(numberOfNodes, UNDEFINED);
+        idom[VIRTUAL_ROOT] = VIRTUAL_ROOT;
+        auto intersect = [&idom, &postOrderNumbers](uint32_t a, uint32_t b) {
+            while (a != b) {
+                while (postOrderNumbers[a] < postOrderNumbers[b]) {
+                    a = idom[a];
+                }
+                while (postOrderNumbers[b] < postOrderNumbers[a]) {
+                    b = idom[b];
+                }
+            }
+            return a;
+        };
+
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (uint32_t node : order) {
+                if (node == VIRTUAL_ROOT) {
+                    continue;
+                }
+
+                uint32_t newIdom = UNDEFINED;
+                for (uint64_t index = predecessorOffsets[node]; index < predecessorOffsets[node + 1]; index++) {
+                    uint32_t predecessor = predecessors[index];
+                    if (idom[predecessor] != UNDEFINED) {
+                        newIdom = newIdom == UNDEFINED ? predecessor : intersect(predecessor, newIdom);
+                    }
+                }
+                if (idom[node] != newIdom) {
+                    idom[node] = newIdom;
+                    changed = true;
+                }
+            }
+        }
+
+        return idom;
+    }
+
+    std::string_view className(const Graph& graph, uint32_t node) {
+        if (node == VIRTUAL_ROOT) {
+            return "<roots>";
+        }
+        uint64_t classIndex = graph.classIndices[node];
+        return classIndex < graph.classNames.size() ? std::string_view(graph.classNames[classIndex]) : "?";
+    }
+
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <heap dump> [number of retainers]" << std::endl;
+        return 1;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "Cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+    size_t limit = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 25;
+
+    try {
+        Graph graph = read(in);
+        std::vector<uint32_t> postOrderNumbers;
+        std::vector<uint32_t> order = reversePostOrder(graph, postOrderNumbers);
+        std::vector<uint32_t> idom = dominators(graph, order, postOrderNumbers);
+
+        // Each node is visited after everything it dominates, so its retained size is complete once it is added
+        // to its dominator...
+        std::vector<uint64_t> retained(graph.shallowSizes);
+        for (auto node = order.rbegin(); node != order.rend(); ++node) {
+            if (*node != VIRTUAL_ROOT) {
+                retained[idom[*node]] += retained[*node];
+            }
+        }
+
+        size_t numberOfObjects = graph.shallowSizes.size() - 1;
+        uint64_t totalBytes = 0;
+        for (uint64_t size : graph.shallowSizes) {
+            totalBytes += size;
+        }
+        std::cout << "Objects:     " << numberOfObjects << " (" << totalBytes << " bytes)" << std::endl;
+        std::cout << "Reachable:   " << order.size() - 1 << " (" << retained[VIRTUAL_ROOT] << " bytes)" << std::endl;
+        std::cout << "Unreachable: " << numberOfObjects - (order.size() - 1) << " ("
+                  << totalBytes - retained[VIRTUAL_ROOT] << " bytes)" << std::endl << std::endl;
+
+        std::vector<uint32_t> retainers(order.begin(), order.end());
+        retainers.erase(std::remove(retainers.begin(), retainers.end(), VIRTUAL_ROOT), retainers.end());
+        limit = std::min(limit, retainers.size());
+        std::partial_sort(retainers.begin(), retainers.begin() + limit, retainers.end(),
+                          [&retained](uint32_t a, uint32_t b) { return retained[a] > retained[b]; });
+
+        std::cout << std::setw(14) << "Retained" << std::setw(12) << "Shallow" << "  Class (dominated by)"
+                  << std::endl;
+        for (size_t i = 0; i < limit; i++) {
+            uint32_t node = retainers[i];
+            std::cout << std::setw(14) << retained[node] << std::setw(12) << graph.shallowSizes[node] << "  "
+                      << className(graph, node) << " (" << className(graph, idom[node]) << ")" << std::endl;
+        }
+    } catch (std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include <vector>
+
+#include "AllocationProfiler.h"
+
+namespace pimii {
+
+    void AllocationProfiler::record(ObjectPointer activeContext, SmallInteger ip, ObjectPointer type, Word bytes) {
+        std::vector<ObjectPointer> contexts;
+        for (ObjectPointer context = activeContext;
+             context != Nil::NIL && contexts.size() < MAX_FRAMES; context = context[System::CONTEXT_SENDER_FIELD]) {
+            contexts.push_back(context);
+        }
+
+        std::string stack;
+        for (auto context = contexts.rbegin(); context != contexts.rend(); ++context) {
+            appendMethod(stack, *context);
+            stack += ';';
+        }
+
+        if (!contexts.empty()) {
+            stack.insert(stack.size() - 1, "@" + std::to_string(ip));
+        }
+
+        stack += type == Nil::NIL ? "?" : type[System::TYPE_FIELD_NAME].stringView();
+        stacks[stack] += bytes;
+    }
+
+    /**
+     * Appends "Owner>>selector" for a method context or "[] in Owner>>selector" for a block context.
+     */
+    void AllocationProfiler::appendMethod(std::string& frame, ObjectPointer context) {
+        ObjectPointer method = context[System::CONTEXT_METHOD_FIELD];
+        if (method.isSmallInt()) {
+            frame += "[] in ";
+            method = context[System::CONTEXT_HOME_FIELD][System::CONTEXT_METHOD_FIELD];
+        }
+
+        ObjectPointer owner = method[System::COMPILED_METHOD_FIELD_OWNER];
+        ObjectPointer selector = method[System::COMPILED_METHOD_FIELD_SELECTOR];
+        frame += owner == Nil::NIL ? "?" : owner[System::TYPE_FIELD_NAME].stringView();
+        frame += ">>";
+        frame += selector == Nil::NIL ? "?" : selector.stringView();
+    }
+
+    void AllocationProfiler::write(std::ostream& out) const {
+        for (auto& [stack, bytes] : stacks) {
+            out << stack << " " << bytes << "\n";
+        }
+        out.flush();
+    }
+
+}
@@ -0,0 +1,55 @@
+#ifndef PIMII_ALLOCATIONPROFILER_H
+#define PIMII_ALLOCATIONPROFILER_H
+
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+#include "System.h"
+
+namespace pimii {
+
+    /**
+     * Aggregates the allocations sampled by the MemoryManager (see MemoryManager::profileAllocations) per call stack.
+     * Each stack consists of the methods of all active contexts, the IP of the innermost one and the class of the
+     * allocated object. The result is reported as folded stacks, as accepted by flamegraph tools.
+     */
+    class AllocationProfiler {
+        System& system;
+        std::unordered_map<std::string, uint64_t> stacks;
+
+        void appendMethod(std::string& frame, ObjectPointer context);
+
+    public:
+        /**
+         * Limits the number of contexts recorded per sample. Deeper stacks are truncated at their outermost end.
+         */
+        static constexpr size_t MAX_FRAMES = 64;
+
+        /**
+         * Contains the default number of bytes between two samples.
+         */
+        static constexpr Word DEFAULT_INTERVAL_BYTES = 512 * 1024;
+
+        explicit AllocationProfiler(System& system) : system(system) {}
+
+        /**
+         * Records an allocation of the given type which represents the given number of bytes. The active context
+         * is executed at the given IP, as the IP of the active context isn't stored in the context itself.
+         */
+        void record(ObjectPointer activeContext, SmallInteger ip, ObjectPointer type, Word bytes);
+
+        /**
+         * Writes one line per stack, which lists its frames (outermost first) separated by ';' followed by
+         * the number of allocated bytes.
+         */
+        void write(std::ostream& out) const;
+
+        void reset() {
+            stacks.clear();
+        }
+    };
+
+}
+
+#endif //PIMII_ALLOCATIONPROFILER_H
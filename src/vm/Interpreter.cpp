@@ -3,10 +3,15 @@
 //
 
 #include <array>
+#include <csignal>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <thread>
 
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include "Interpreter.h"
 #include "Primitives.h"
 #include "../common/Looping.h"
@@ -14,10 +19,28 @@
 
 namespace pimii {
 
+    std::atomic<bool> Interpreter::heapDumpRequested = false;
 
-    Interpreter::Interpreter(System& system) : system(system), contextSwitchExpected(false) {
+    Interpreter::Interpreter(System& system) : system(system), contextSwitchExpected(false), allocationProfiler(system),
+                                               snapshotRequested(false), snapshotProcess(-1), snapshotSucceeded(false),
+                                               methodCache(), methodCacheVersion(Methods::version()) {
         startup = std::chrono::steady_clock::now();
         lastMetrics = std::chrono::steady_clock::now();
+
+        for (ObjectPointer* reg : registers()) {
+            system.memoryManager().registerRoot(*reg);
+        }
+    }
+
+    Interpreter::~Interpreter() {
+        MemoryManager::profileAllocations(0, nullptr);
+        for (ObjectPointer* reg : registers()) {
+            system.memoryManager().unregisterRoot(*reg);
+        }
+    }
+
+    std::array<ObjectPointer*, 6> Interpreter::registers() {
+        return {&activeContext, &homeContext, &method, &opCodes, &receiver, &rootProcess};
     }
 
     void Interpreter::run(ObjectPointer rootContext) {
@@ -39,12 +62,25 @@ namespace pimii {
                 ObjectPointer currentProcess = system.processor()[System::PROCESSOR_FIELD_ACTIVE_PROCESS];
                 if (currentProcess != Nil::NIL) {
                     storeContextRegisters();
-                    currentProcess[System::PROCESS_FIELD_CONTEXT] = activeContext;
+                    currentProcess.store(System::PROCESS_FIELD_CONTEXT, activeContext);
                     system.memoryManager().runRecommendedGC();
                     currentProcess = system.processor()[System::PROCESSOR_FIELD_ACTIVE_PROCESS];
                     activeContext = currentProcess[System::PROCESS_FIELD_CONTEXT];
                     fetchContextRegisters();
+                    handleCollectedGarbage();
                 }
+            } else if (system.memoryManager().shouldPerformMarkingStep()) {
+                system.memoryManager().performMarkingStep();
+            }
+
+            if (heapDumpRequested.exchange(false)) {
+                std::ofstream out(heapDumpFile, std::ios::binary);
+                system.writeHeapDump(out);
+            }
+
+            // saveImage refuses to store mark bits, therefore a pending snapshot waits for the marking to finish...
+            if (snapshotRequested && !system.memoryManager().isMarking()) {
+                forkSnapshot();
             }
 
             if (contextSwitchExpected) {
@@ -57,14 +93,58 @@ namespace pimii {
         }
     }
 
+    /**
+     * Updates all state which depends on the location of objects once the GC has moved these.
+     */
+    void Interpreter::handleCollectedGarbage() {
+        if (system.memoryManager().hasClearedWeakReferences()) {
+            system.symbolTable().rehash();
+        }
+        methodCache.fill(MethodCacheEntry());
+
+        // Wake up the finalization process, which fetches the queued finalizers via System nextFinalizer...
+        if (system.memoryManager().hasQueuedFinalizers()) {
+            signalSemaphore(system.processor()[System::PROCESSOR_FIELD_FINALIZATION_SEMAPHORE]);
+        }
+
+        // Even a full collection couldn't get the heap below its soft limit - let the image drop some caches...
+        if (system.memoryManager().hasLowSpace()) {
+            signalSemaphore(system.processor()[System::PROCESSOR_FIELD_LOW_SPACE_SEMAPHORE]);
+        }
+    }
+
+    /**
+     * Collects garbage while no process is runnable. The work is limited to the time remaining until the next
+     * timer tick, so that waiting processes are resumed in time. Sleeps if there is nothing worth collecting.
+     */
+    void Interpreter::idleGC() {
+        SmallInteger untilTimer = TIMER_INTERVAL_MILLIS * 1000 -
+                                  std::chrono::duration_cast<std::chrono::microseconds>(
+                                          std::chrono::steady_clock::now() - lastTimer).count();
+        if (untilTimer <= 0 || !system.memoryManager().shouldIdleGC()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            return;
+        }
+
+        // All registers are roots and the active process has already been stored, therefore this is a safepoint...
+        if (system.memoryManager().idleGC(std::min(untilTimer, IDLE_GC_SLICE_MICROS))) {
+            handleCollectedGarbage();
+        }
+    }
+
     void Interpreter::notifySemaphores() {
         std::chrono::milliseconds delta = std::chrono::duration_cast<std::chrono::milliseconds>(
                 std::chrono::steady_clock::now() - lastTimer);
 
-        if (delta.count() > 200) {
+        if (delta.count() > TIMER_INTERVAL_MILLIS) {
             ObjectPointer semaphore = system.processor()[System::PROCESSOR_FIELD_TIMER_SEMAPHORE];
             signalSemaphore(semaphore);
             lastTimer = std::chrono::steady_clock::now();
+
+            // Polling on each timer tick is precise enough for a snapshot and spares us a SIGCHLD handler...
+            if (snapshotProcess > 0) {
+                awaitSnapshot();
+            }
         } else {
             if (inputAvailable) {
                 std::lock_guard lock(inputQueueMutex);
@@ -83,26 +163,14 @@ namespace pimii {
         if (activeProcess != Nil::NIL) {
             activeProcess[System::PROCESS_FIELD_TIME] =
                     activeProcess[System::PROCESS_FIELD_TIME].smallInt() + elapsedTime;
-            activeProcess[System::PROCESS_FIELD_CONTEXT] = activeContext;
+            activeProcess.store(System::PROCESS_FIELD_CONTEXT, activeContext);
         }
-        system.processor()[System::PROCESSOR_FIELD_ACTIVE_PROCESS] = Nil::NIL;
+        system.processor().store(System::PROCESSOR_FIELD_ACTIVE_PROCESS, Nil::NIL);
 
         ObjectPointer nextProcess = popFront(system.processor(), System::PROCESSOR_FIELD_FIRST_WAITING_PROCESS,
                                              System::PROCESSOR_FIELD_LAST_WAITING_PROCESS);
         while (nextProcess == Nil::NIL) {
-            /*
-            if (activeContext != Nil::NIL && system.memoryManager().shouldIdleGC()) {
-                storeContextRegisters();
-                activeProcess[System::PROCESS_FIELD_CONTEXT] = activeContext;
-                system.memoryManager().idleGC();
-                activeProcess = system.processor()[System::PROCESSOR_FIELD_ACTIVE_PROCESS];
-                activeContext = activeProcess[System::PROCESS_FIELD_CONTEXT];
-                fetchContextRegisters();
-            }
-             */
-
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
-
+            idleGC();
             notifySemaphores();
             nextProcess = popFront(system.processor(), System::PROCESSOR_FIELD_FIRST_WAITING_PROCESS,
                                    System::PROCESSOR_FIELD_LAST_WAITING_PROCESS);
@@ -112,7 +180,7 @@ namespace pimii {
         lastContextSwitch = std::chrono::steady_clock::now();
 
 
-        system.processor()[System::PROCESSOR_FIELD_ACTIVE_PROCESS] = nextProcess;
+        system.processor().store(System::PROCESSOR_FIELD_ACTIVE_PROCESS, nextProcess);
 
         newActiveContext(nextProcess[System::PROCESS_FIELD_CONTEXT]);
         activeMicros += elapsedTime;
@@ -159,13 +227,13 @@ namespace pimii {
                 push(receiver[index]);
                 return;
             case OP_POP_AND_STORE_RECEIVER_FIELD:
-                receiver[index] = pop();
+                receiver.store(index, pop());
                 return;
             case OP_POP_AND_STORE_IN_TEMPORARY:
                 temporary(index, pop());
                 return;
             case OP_POP_AND_STORE_IN_LITERAL_VARIABLE:
-                literal(index)[System::ASSOCIATION_FIELD_VALUE] = pop();
+                literal(index).store(System::ASSOCIATION_FIELD_VALUE, pop());
                 return;
             case OP_POP:
                 pop();
@@ -222,6 +290,98 @@ namespace pimii {
         }
     }
 
+    /**
+     * Returns the id of the SendSite table of the given method, which is created once the method first allocates.
+     */
+    uint32_t Interpreter::sendSiteTable(ObjectPointer compiledMethod) {
+        ObjectPointer table = compiledMethod[System::COMPILED_METHOD_FIELD_SEND_SITES];
+        if (table.isSmallInt()) {
+            return static_cast<uint32_t>(table.smallInt());
+        }
+
+        ObjectPointer byteCodes = compiledMethod[System::COMPILED_METHOD_FIELD_OPCODES];
+        uint32_t result = system.memoryManager().makeSendSiteTable(
+                byteCodes == Nil::NIL ? 0 : static_cast<Word>(byteCodes.byteSize()));
+        compiledMethod[System::COMPILED_METHOD_FIELD_SEND_SITES] = ObjectPointer::forSmallInt(result);
+        return result;
+    }
+
+    /**
+     * Determines the allocation site of an object created by a primitive which has just been sent by the active
+     * method. As most objects are created by generic methods like Behaviour>>new:, the send within the sender which
+     * led here is used if it is monomorphic, i.e. if it always ended up at the same allocating send (see SendSite).
+     */
+    AllocationSite* Interpreter::allocationSite() {
+        uint32_t table = sendSiteTable(method);
+        SendSite& send = system.memoryManager().sendSite(table, ip);
+        ObjectPointer sender = homeContext[System::CONTEXT_SENDER_FIELD];
+        if (sender == Nil::NIL) {
+            return &send.site;
+        }
+
+        ObjectPointer senderMethod = isBlockContext(sender)
+                                     ? sender[System::CONTEXT_HOME_FIELD][System::CONTEXT_METHOD_FIELD]
+                                     : sender[System::CONTEXT_METHOD_FIELD];
+        SendSite& caller = system.memoryManager().sendSite(sendSiteTable(senderMethod),
+                                                           sender[System::CONTEXT_IP_FIELD].smallInt());
+
+        // Table ids are stored incremented by one, so that 0 marks a send which hasn't allocated yet...
+        if (caller.calleeTable == 0) {
+            caller.calleeTable = table + 1;
+            caller.calleeIP = static_cast<uint32_t>(ip);
+        }
+
+        if (caller.calleeTable == table + 1 && caller.calleeIP == static_cast<uint32_t>(ip)) {
+            return &caller.calleeSite;
+        }
+
+        return &send.site;
+    }
+
+    void Interpreter::profileAllocations(Word intervalBytes) {
+        MemoryManager::profileAllocations(intervalBytes, [this](ObjectPointer obj, Word bytes) {
+            allocationProfiler.record(activeContext, ip, obj.type(), bytes);
+        });
+    }
+
+    void Interpreter::dumpHeapOnSignal(int signal, const std::string& fileName) {
+        heapDumpFile = fileName;
+        std::signal(signal, [](int) { heapDumpRequested = true; });
+    }
+
+    bool Interpreter::requestSnapshot(const std::string& fileName) {
+        if (snapshotRequested || snapshotProcess > 0) {
+            return false;
+        }
+
+        snapshotFile = fileName;
+        snapshotRequested = true;
+        return true;
+    }
+
+    void Interpreter::forkSnapshot() {
+        snapshotRequested = false;
+        snapshotProcess = system.memoryManager().forkImageWriter(snapshotFile, system.imageRoots());
+        if (snapshotProcess < 0) {
+            snapshotSucceeded = false;
+            signalSemaphore(system.processor()[System::PROCESSOR_FIELD_SNAPSHOT_SEMAPHORE]);
+        }
+    }
+
+    /**
+     * Reaps the snapshot process once it has exited and signals the snapshot semaphore.
+     */
+    void Interpreter::awaitSnapshot() {
+        int status;
+        if (waitpid(snapshotProcess, &status, WNOHANG) != snapshotProcess) {
+            return;
+        }
+
+        snapshotProcess = -1;
+        snapshotSucceeded = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        signalSemaphore(system.processor()[System::PROCESSOR_FIELD_SNAPSHOT_SEMAPHORE]);
+    }
+
     void Interpreter::storeContextRegisters() {
         activeContext[System::CONTEXT_IP_FIELD] = ip;
         activeContext[System::CONTEXT_SP_FIELD] = sp;
@@ -265,7 +425,7 @@ namespace pimii {
     }
 
     void Interpreter::temporary(SmallInteger index, ObjectPointer value) {
-        homeContext[System::CONTEXT_FIXED_SIZE + index] = value;
+        homeContext.store(System::CONTEXT_FIXED_SIZE + index, value);
     }
 
     ObjectPointer Interpreter::literal(SmallInteger index) {
@@ -296,6 +456,26 @@ namespace pimii {
         return Nil::NIL;
     }
 
+    ObjectPointer Interpreter::lookupMethod(ObjectPointer type, ObjectPointer selector) {
+        if (methodCacheVersion != Methods::version()) {
+            methodCache.fill(MethodCacheEntry());
+            methodCacheVersion = Methods::version();
+        }
+
+        uint32_t classIndex = ObjectPointer::classIndexOf(type);
+        MethodCacheEntry& entry = methodCache[(classIndex ^ (selector.id() >> 2)) % METHOD_CACHE_SIZE];
+        if (entry.classIndex == classIndex && entry.selector == selector) {
+            return entry.method;
+        }
+
+        ObjectPointer method = findMethod(type, selector);
+        if (method != Nil::NIL) {
+            entry = {classIndex, selector, method};
+        }
+
+        return method;
+    }
+
     ObjectPointer Interpreter::findMethodInType(ObjectPointer type, ObjectPointer selector) {
         ObjectPointer selectors = type[System::TYPE_FIELD_SELECTORS];
         for (Looping loop = Looping(selectors.size(), selector.id()); loop.hasNext(); loop.next()) {
@@ -312,7 +492,7 @@ namespace pimii {
     void Interpreter::send(ObjectPointer selector, SmallInteger numArguments) {
         ObjectPointer newReceiver = stackValue(numArguments);
         ObjectPointer type = system.type(newReceiver);
-        ObjectPointer newMethod = findMethod(type, selector);
+        ObjectPointer newMethod = lookupMethod(type, selector);
 
         if (newMethod == Nil::NIL) {
             std::stringstream errorMessage;
@@ -335,7 +515,7 @@ namespace pimii {
         } else if (header.methodType() == CompiledMethodType::MT_POP_AND_STORE_FIELD) {
             //TODO range check
             //pop(); //assert numArguments == 1
-            newReceiver[header.fieldIndex()] = pop();
+            newReceiver.store(header.fieldIndex(), pop());
             //push(newReceiver);
             return;
         }
@@ -458,9 +638,9 @@ namespace pimii {
             return Nil::NIL;
         }
 
-        list[first] = next[System::LINK_NEXT];
+        list.store(first, next[System::LINK_NEXT]);
         if (list[first] == Nil::NIL) {
-            list[last] = Nil::NIL;
+            list.store(last, Nil::NIL);
         }
 
         return next[System::LINK_VALUE];
@@ -471,11 +651,11 @@ namespace pimii {
         link[System::LINK_VALUE] = value;
         ObjectPointer head = list[first];
         if (head == Nil::NIL) {
-            list[last] = link;
+            list.store(last, link);
         } else {
-            link[System::LINK_NEXT] = head;
+            link.store(System::LINK_NEXT, head);
         }
-        list[first] = link;
+        list.store(first, link);
     }
 
     void Interpreter::pushBack(ObjectPointer value, ObjectPointer list, SmallInteger first, SmallInteger last) {
@@ -483,11 +663,11 @@ namespace pimii {
         link[System::LINK_VALUE] = value;
         ObjectPointer tail = list[last];
         if (tail == Nil::NIL) {
-            list[first] = link;
+            list.store(first, link);
         } else {
-            tail[System::LINK_NEXT] = link;
+            tail.store(System::LINK_NEXT, link);
         }
-        list[last] = link;
+        list.store(last, link);
     }
 
     SmallInteger Interpreter::elapsedMicros() {
@@ -5,7 +5,13 @@
 #ifndef MEM_INTERPRETER_H
 #define MEM_INTERPRETER_H
 
+#include <array>
+#include <atomic>
+
+#include <sys/types.h>
+
 #include "System.h"
+#include "AllocationProfiler.h"
 
 namespace pimii {
 
@@ -37,6 +43,22 @@ namespace pimii {
         std::deque<std::string> queuedInputs;
         std::mutex inputQueueMutex;
 
+        AllocationProfiler allocationProfiler;
+
+        std::string heapDumpFile;
+        static std::atomic<bool> heapDumpRequested;
+
+        std::string snapshotFile;
+        bool snapshotRequested;
+        pid_t snapshotProcess;
+        bool snapshotSucceeded;
+
+        void forkSnapshot();
+
+        void awaitSnapshot();
+
+        std::array<ObjectPointer*, 6> registers();
+
         uint8_t fetchInstruction();
 
         void dispatchInstruction(uint8_t opCode);
@@ -55,8 +77,43 @@ namespace pimii {
 
         ObjectPointer findMethodInType(ObjectPointer type, ObjectPointer selector);
 
+        struct MethodCacheEntry {
+            uint32_t classIndex;
+            ObjectPointer selector;
+            ObjectPointer method;
+        };
+
+        static constexpr Word METHOD_CACHE_SIZE = 1024;
+
+        /**
+         * Caches the results of findMethod keyed on the class index of the receiver and the selector. As selectors
+         * and methods are moved by the GC, the cache is flushed after each collection. It is also flushed once a
+         * method has been added or replaced (see Methods::version).
+         */
+        std::array<MethodCacheEntry, METHOD_CACHE_SIZE> methodCache;
+        SmallInteger methodCacheVersion;
+
+        ObjectPointer lookupMethod(ObjectPointer type, ObjectPointer selector);
+
+        uint32_t sendSiteTable(ObjectPointer compiledMethod);
+
         bool executePrimitive(SmallInteger index, SmallInteger numberOfArguments);
 
+        /**
+         * Contains the interval in which the timer semaphore is signaled.
+         */
+        static constexpr SmallInteger TIMER_INTERVAL_MILLIS = 200;
+
+        /**
+         * Contains the maximal time (in microseconds) spent collecting garbage before checking for runnable processes
+         * again if the scheduler is idle.
+         */
+        static constexpr SmallInteger IDLE_GC_SLICE_MICROS = 10000;
+
+        void handleCollectedGarbage();
+
+        void idleGC();
+
 
         void performBlockCopy(uint8_t index);
 
@@ -119,6 +176,8 @@ namespace pimii {
 
         explicit Interpreter(System& system);
 
+        ~Interpreter();
+
         ObjectPointer currentActiveContext() {
             return activeContext;
         }
@@ -127,6 +186,8 @@ namespace pimii {
             return ip;
         }
 
+        AllocationSite* allocationSite();
+
         SmallInteger elapsedMicros();
 
         void newActiveContext(ObjectPointer context);
@@ -135,12 +196,43 @@ namespace pimii {
 
         void updateMetrics();
 
+        /**
+         * Records about every n-th allocated byte (as given by intervalBytes) in the allocationProfile. An interval
+         * of 0 disables the profiling.
+         */
+        void profileAllocations(Word intervalBytes);
+
+        AllocationProfiler& allocationProfile() {
+            return allocationProfiler;
+        }
+
+        /**
+         * Writes a heap dump (see MemoryManager::writeHeapDump) into the given file each time the given signal is
+         * received. The handler only flags the request, the dump itself is written by run at its next safepoint.
+         */
+        void dumpHeapOnSignal(int signal, const std::string& fileName);
+
+        /**
+         * Requests a snapshot of the heap into the given image file (see MemoryManager::saveImage). Writing a large
+         * image takes a while, therefore run forks the VM at its next safepoint, where no marking is in progress. The
+         * child writes its copy-on-write view of the heap and exits, while this process keeps running. Once the
+         * child is reaped, the snapshot semaphore is signaled. Returns false if a snapshot is already in progress.
+         */
+        bool requestSnapshot(const std::string& fileName);
+
+        /**
+         * Determines if the last snapshot has been written completely.
+         */
+        bool lastSnapshotSucceeded() const {
+            return snapshotSucceeded;
+        }
+
         void push(ObjectPointer value) {
             SmallInteger index = basePointer() + (sp++);
             if (index >= activeContext.size()) {
                 throw std::overflow_error("stack overflow");
             }
-            activeContext[index] = value;
+            activeContext.store(index, value);
         }
 
 
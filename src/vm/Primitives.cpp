@@ -2,6 +2,8 @@
 // Created by Andreas Haufler on 26.11.18.
 //
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <cmath>
 #include "Primitives.h"
@@ -152,7 +154,8 @@ namespace pimii {
         ObjectPointer type = interpreter.pop();
         //ensure type
         ObjectPointer result = sys.memoryManager().makeObject(
-                type[System::TYPE_FIELD_NUMBER_OF_FIXED_FIELDS].smallInt(), type);
+                type[System::TYPE_FIELD_NUMBER_OF_FIXED_FIELDS].smallInt(), type,
+                interpreter.allocationSite());
 
         interpreter.push(result);
 
@@ -168,6 +171,22 @@ namespace pimii {
         ObjectPointer type = interpreter.pop();
         //TODO ensure type
         ObjectPointer result = sys.memoryManager().makeObject(
+                type[System::TYPE_FIELD_NUMBER_OF_FIXED_FIELDS].smallInt() + size, type,
+                interpreter.allocationSite());
+
+        interpreter.push(result);
+
+        return true;
+    }
+
+    bool Primitives::basicNewWeakWith(Interpreter& interpreter, System& sys, SmallInteger argumentCount) {
+        if (argumentCount != 1) {
+            return false;
+        }
+
+        SmallInteger size = interpreter.pop().smallInt();
+        ObjectPointer type = interpreter.pop();
+        ObjectPointer result = sys.memoryManager().makeWeakObject(
                 type[System::TYPE_FIELD_NUMBER_OF_FIXED_FIELDS].smallInt() + size, type);
 
         interpreter.push(result);
@@ -175,6 +194,45 @@ namespace pimii {
         return true;
     }
 
+    bool Primitives::basicNewEphemeron(Interpreter& interpreter, System& sys, SmallInteger argumentCount) {
+        if (argumentCount != 0) {
+            return false;
+        }
+
+        ObjectPointer type = interpreter.pop();
+        ObjectPointer result = sys.memoryManager().makeEphemeron(
+                type[System::TYPE_FIELD_NUMBER_OF_FIXED_FIELDS].smallInt(), type);
+
+        interpreter.push(result);
+
+        return true;
+    }
+
+    bool Primitives::registerFinalizer(Interpreter& interpreter, System& sys, SmallInteger argumentCount) {
+        if (argumentCount != 2) {
+            return false;
+        }
+
+        ObjectPointer finalizer = interpreter.pop();
+        ObjectPointer obj = interpreter.pop();
+        interpreter.pop();
+        sys.memoryManager().registerFinalizer(obj, finalizer);
+
+        interpreter.push(obj);
+
+        return true;
+    }
+
+    bool Primitives::nextFinalizer(Interpreter& interpreter, System& sys, SmallInteger argumentCount) {
+        if (argumentCount != 0) {
+            return false;
+        }
+
+        interpreter.pop();
+        interpreter.push(sys.memoryManager().nextFinalizer());
+
+        return true;
+    }
 
     bool Primitives::basicAllocWith(Interpreter& interpreter, System& sys, SmallInteger argumentCount) {
         if (argumentCount != 1) {
@@ -185,13 +243,217 @@ namespace pimii {
         ObjectPointer type = interpreter.pop();
         //TODO ensure type
         //TODO type[System::TYPE_FIELD_NUMBER_OF_FIXED_FIELDS] == 0
-        ObjectPointer result = sys.memoryManager().makeBuffer(size, type);
+        ObjectPointer result = sys.memoryManager().makeBuffer(
+                size, type, interpreter.allocationSite());
 
         interpreter.push(result);
 
         return true;
     }
 
+    bool Primitives::basicAllocExternalWith(Interpreter& interpreter, System& sys, SmallInteger argumentCount) {
+        if (argumentCount != 1) {
+            return false;
+        }
+
+        SmallInteger size = interpreter.pop().smallInt();
+        ObjectPointer type = interpreter.pop();
+        ObjectPointer result = sys.memoryManager().makeExternalBuffer(size, type);
+
+        interpreter.push(result);
+
+        return true;
+    }
+
+    /**
+     * Returns an Array which contains an Association per class present in the heap. Each maps the class to an Array
+     * containing the number of instances and the bytes these occupy. Both values saturate at the largest SmallInteger.
+     */
+    bool Primitives::census(Interpreter& interpreter, System& sys, SmallInteger argumentCount) {
+        if (argumentCount != 0) {
+            return false;
+        }
+
+        std::vector<ClassCensus> census = sys.memoryManager().census();
+        auto saturated = [](uint64_t value) {
+            return ObjectPointer::forSmallInt(static_cast<SmallInteger>(
+                    std::min<uint64_t>(value, static_cast<uint64_t>(SmallIntegers::maxSmallInt()))));
+        };
+
+        interpreter.pop();
+        auto numberOfClasses = std::count_if(census.begin(), census.end(),
+                                             [](const ClassCensus& entry) { return entry.instances > 0; });
+        ObjectPointer result = sys.memoryManager().makeObject(SmallIntegers::toSmallInteger(numberOfClasses),
+                                                              sys.typeArray());
+        SmallInteger nextIndex = 0;
+        for (size_t index = 0; index < census.size(); index++) {
+            if (census[index].instances == 0) {
+                continue;
+            }
+
+            ObjectPointer counts = sys.memoryManager().makeObject(2, sys.typeArray());
+            counts[0] = saturated(census[index].instances);
+            counts[1] = saturated(census[index].bytes);
+
+            ObjectPointer association = sys.memoryManager().makeObject(System::ASSOCIATION_SIZE,
+                                                                       sys.typeAssociation());
+            association[System::ASSOCIATION_FIELD_KEY] = ObjectPointer::classTable[index];
+            association[System::ASSOCIATION_FIELD_VALUE] = counts;
+            result.store(nextIndex++, association);
+        }
+
+        interpreter.push(result);
+
+        return true;
+    }
+
+    bool Primitives::printCensus(Interpreter& interpreter, System& sys, SmallInteger argumentCount) {
+        if (argumentCount != 1) {
+            return false;
+        }
+
+        SmallInteger limit = interpreter.pop().smallInt();
+        if (limit < 0) {
+            return false;
+        }
+
+        sys.printCensus(std::cout, static_cast<size_t>(limit));
+
+        return true;
+    }
+
+    /**
+     * Starts (or with an interval of 0, stops) sampling about every n-th allocated byte. Previous samples are kept.
+     */
+    bool Primitives::profileAllocations(Interpreter& interpreter, System& sys, SmallInteger argumentCount) {
+        if (argumentCount != 1) {
+            return false;
+        }
+
+        SmallInteger intervalBytes = interpreter.pop().smallInt();
+        if (intervalBytes < 0) {
+            return false;
+        }
+
+        interpreter.profileAllocations(static_cast<Word>(intervalBytes));
+
+        return true;
+    }
+
+    /**
+     * Writes the sampled allocations as folded stacks into the file with the given name.
+     */
+    bool Primitives::writeAllocationProfile(Interpreter& interpreter, System& sys, SmallInteger argumentCount) {
+        if (argumentCount != 1) {
+            return false;
+        }
+
+        ObjectPointer fileName = interpreter.pop();
+        if (!sys.is(fileName, sys.typeString())) {
+            return false;
+        }
+
+        std::ofstream out{std::string(fileName.stringView())};
+        if (!out) {
+            return false;
+        }
+        interpreter.allocationProfile().write(out);
+
+        return true;
+    }
+
+    /**
+     * Writes a heap dump (see HeapDump) into the file with the given name, which can be analyzed by pimii-heapdump.
+     */
+    bool Primitives::writeHeapDump(Interpreter& interpreter, System& sys, SmallInteger argumentCount) {
+        if (argumentCount != 1) {
+            return false;
+        }
+
+        ObjectPointer fileName = interpreter.pop();
+        if (!sys.is(fileName, sys.typeString())) {
+            return false;
+        }
+
+        std::ofstream out(std::string(fileName.stringView()), std::ios::binary);
+        if (!out) {
+            return false;
+        }
+        sys.writeHeapDump(out);
+
+        return true;
+    }
+
+    bool Primitives::allInstancesOf(Interpreter& interpreter, System& sys, SmallInteger argumentCount) {
+        if (argumentCount != 1) {
+            return false;
+        }
+
+        ObjectPointer type = interpreter.pop();
+        interpreter.pop();
+        interpreter.push(makeArray(sys, sys.memoryManager().allInstancesOf(type)));
+
+        return true;
+    }
+
+    /**
+     * Answers all objects referencing the given one. Note that this includes the context which invoked the
+     * primitive, as the argument is still present in its stack.
+     */
+    bool Primitives::allReferencesTo(Interpreter& interpreter, System& sys, SmallInteger argumentCount) {
+        if (argumentCount != 1) {
+            return false;
+        }
+
+        ObjectPointer target = interpreter.pop();
+        interpreter.pop();
+        interpreter.push(makeArray(sys, sys.memoryManager().allReferencesTo(target)));
+
+        return true;
+    }
+
+    /**
+     * Starts writing a snapshot of the heap into the image with the given name in the background (see
+     * Interpreter::requestSnapshot). Answers false if a snapshot is already in progress.
+     */
+    bool Primitives::saveSnapshot(Interpreter& interpreter, System& sys, SmallInteger argumentCount) {
+        if (argumentCount != 1) {
+            return false;
+        }
+
+        ObjectPointer fileName = interpreter.pop();
+        if (!sys.is(fileName, sys.typeString())) {
+            return false;
+        }
+
+        interpreter.pop();
+        interpreter.push(interpreter.requestSnapshot(std::string(fileName.stringView())) ? sys.valueTrue()
+                                                                                           : sys.valueFalse());
+
+        return true;
+    }
+
+    bool Primitives::snapshotSucceeded(Interpreter& interpreter, System& sys, SmallInteger argumentCount) {
+        if (argumentCount != 0) {
+            return false;
+        }
+
+        interpreter.pop();
+        interpreter.push(interpreter.lastSnapshotSucceeded() ? sys.valueTrue() : sys.valueFalse());
+
+        return true;
+    }
+
+    ObjectPointer Primitives::makeArray(System& sys, const std::vector<ObjectPointer>& elements) {
+        ObjectPointer result = sys.memoryManager().makeObject(SmallIntegers::toSmallInteger(elements.size()),
+                                                              sys.typeArray());
+        for (size_t index = 0; index < elements.size(); index++) {
+            result.store(static_cast<SmallInteger>(index), elements[index]);
+        }
+
+        return result;
+    }
+
     bool Primitives::byteAt(Interpreter& interpreter, System& sys, SmallInteger argumentCount) {
         if (argumentCount != 1) {
             return false;
@@ -343,7 +605,7 @@ namespace pimii {
         blockContext[System::CONTEXT_IP_FIELD] =
                 blockContext[System::CONTEXT_INITIAL_IP_FIELD].smallInt();
         blockContext[System::CONTEXT_SP_FIELD] = argumentCount;
-        blockContext[System::CONTEXT_CALLER_FIELD] = interpreter.currentActiveContext();
+        blockContext.store(System::CONTEXT_CALLER_FIELD, interpreter.currentActiveContext());
 
         interpreter.newActiveContext(blockContext);
 
@@ -382,7 +644,7 @@ namespace pimii {
         ObjectPointer value = interpreter.pop();
         SmallInteger index = interpreter.pop().smallInt() - 1;
         ObjectPointer self = interpreter.stackTop();
-        self[self.type()[System::TYPE_FIELD_NUMBER_OF_FIXED_FIELDS].smallInt() + index] = value;
+        self.store(self.type()[System::TYPE_FIELD_NUMBER_OF_FIXED_FIELDS].smallInt() + index, value);
 
         return true;
     }
@@ -423,7 +685,7 @@ namespace pimii {
         ObjectPointer value = interpreter.pop();
         SmallInteger index = interpreter.pop().smallInt() - 1;
         ObjectPointer self = interpreter.stackTop();
-        self[index] = value;
+        self.store(index, value);
 
         return true;
     }
@@ -461,17 +723,16 @@ namespace pimii {
             return false;
         }
 
-        interpreter.pop(argumentCount);
-
         blockContext[System::CONTEXT_IP_FIELD] =
                 blockContext[System::CONTEXT_INITIAL_IP_FIELD].smallInt();
-        blockContext[System::CONTEXT_SP_FIELD] = argumentCount;
-        blockContext[System::CONTEXT_CALLER_FIELD] = Nil::NIL;
+        blockContext[System::CONTEXT_SP_FIELD] = 0;
+        blockContext.store(System::CONTEXT_CALLER_FIELD, Nil::NIL);
         // TODO maybe clone HOME_CONTEXT and maybe even the block-context itself(?)
 
         ObjectPointer process = sys.memoryManager().makeObject(System::PROCESS_SIZE, sys.typeProcess());
         process[System::PROCESS_FIELD_CONTEXT] = blockContext;
         process[System::PROCESS_FIELD_TIME] = 0;
+        interpreter.push(process);
 
         interpreter.pushBack(process, sys.processor(), System::PROCESSOR_FIELD_FIRST_WAITING_PROCESS,
                              System::PROCESSOR_FIELD_LAST_WAITING_PROCESS);
@@ -564,10 +825,10 @@ namespace pimii {
         SmallInteger index = interpreter.pop().smallInt();
         interpreter.pop();
 
-        switch (index) {
-            default:
-                interpreter.push(ObjectPointer::forSmallInt(0));
-        }
+        // All counters are currently provided by the GC (see GCLog::counter)...
+        uint64_t value = sys.memoryManager().gcStatistics().counter(index);
+        interpreter.push(ObjectPointer::forSmallInt(static_cast<SmallInteger>(
+                std::min<uint64_t>(value, static_cast<uint64_t>(SmallIntegers::maxSmallInt())))));
 
         return true;
     }
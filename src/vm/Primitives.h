@@ -6,6 +6,7 @@
 #define MEM_PRIMITIVES_H
 
 #include <array>
+#include <functional>
 #include "Interpreter.h"
 
 namespace pimii {
@@ -100,7 +101,37 @@ namespace pimii {
 
         static bool readCounter(Interpreter& interpreter, System& sys, SmallInteger argumentCount);
 
-        static constexpr std::array<Primitive, 49> methods = {equality, lessThan, lessThanOrEqual, greaterThan,
+        static bool basicNewWeakWith(Interpreter& interpreter, System& sys, SmallInteger argumentCount);
+
+        static bool basicNewEphemeron(Interpreter& interpreter, System& sys, SmallInteger argumentCount);
+
+        static bool registerFinalizer(Interpreter& interpreter, System& sys, SmallInteger argumentCount);
+
+        static bool nextFinalizer(Interpreter& interpreter, System& sys, SmallInteger argumentCount);
+
+        static bool basicAllocExternalWith(Interpreter& interpreter, System& sys, SmallInteger argumentCount);
+
+        static bool census(Interpreter& interpreter, System& sys, SmallInteger argumentCount);
+
+        static bool printCensus(Interpreter& interpreter, System& sys, SmallInteger argumentCount);
+
+        static bool profileAllocations(Interpreter& interpreter, System& sys, SmallInteger argumentCount);
+
+        static bool writeAllocationProfile(Interpreter& interpreter, System& sys, SmallInteger argumentCount);
+
+        static bool writeHeapDump(Interpreter& interpreter, System& sys, SmallInteger argumentCount);
+
+        static bool allInstancesOf(Interpreter& interpreter, System& sys, SmallInteger argumentCount);
+
+        static bool allReferencesTo(Interpreter& interpreter, System& sys, SmallInteger argumentCount);
+
+        static bool saveSnapshot(Interpreter& interpreter, System& sys, SmallInteger argumentCount);
+
+        static bool snapshotSucceeded(Interpreter& interpreter, System& sys, SmallInteger argumentCount);
+
+        static ObjectPointer makeArray(System& sys, const std::vector<ObjectPointer>& elements);
+
+        static constexpr std::array<Primitive, 63> methods = {equality, lessThan, lessThanOrEqual, greaterThan,
                                                               greaterThanOrEqual, add, subtract, multiply, divide,
                                                               remainder, bitAnd, bitOr, bitInvert, shiftLeft,
                                                               shiftRight, basicNew, basicNewWith, basicAllocWith,
@@ -109,7 +140,12 @@ namespace pimii {
                                                               perform, perform, perform, performWith, objectAt,
                                                               objectAtPut, objectTransfer, id, size, objectSize, fork,
                                                               wait, signal, at, atPut, transfer, terminalNextEvent,
-                                                              terminalShowString, readCounter};
+                                                              terminalShowString, readCounter, basicNewWeakWith,
+                                                              basicNewEphemeron, registerFinalizer, nextFinalizer,
+                                                              basicAllocExternalWith, census, printCensus,
+                                                              profileAllocations, writeAllocationProfile,
+                                                              writeHeapDump, allInstancesOf, allReferencesTo,
+                                                              saveSnapshot, snapshotSucceeded};
 
 
     public:
@@ -8,10 +8,27 @@
 
 namespace pimii {
 
+    AllocationSite SymbolTable::tableSite;
+    AllocationSite SymbolTable::symbolSite;
+
     SymbolTable::SymbolTable(MemoryManager& mm) : mm(mm), symbolType(Nil::NIL), symbolTable(
             mm.makeRootObject(SIZE, Nil::NIL)) {
         symbolTable[FIELD_TALLY] = 0;
-        symbolTable[FIELD_TABLE] = ObjectPointer(mm.makeObject(512, Nil::NIL));
+        symbolTable[FIELD_TABLE] = ObjectPointer(mm.makeWeakObject(512, Nil::NIL));
+
+        mm.registerRoot(symbolType);
+        mm.registerRoot(symbolTable);
+    }
+
+    SymbolTable::SymbolTable(MemoryManager& mm, ObjectPointer symbolType, ObjectPointer symbolTable)
+            : mm(mm), symbolType(symbolType), symbolTable(symbolTable) {
+        mm.registerRoot(this->symbolType);
+        mm.registerRoot(this->symbolTable);
+    }
+
+    SymbolTable::~SymbolTable() {
+        mm.unregisterRoot(symbolType);
+        mm.unregisterRoot(symbolTable);
     }
 
     ObjectPointer SymbolTable::lookup(const std::string_view& name) {
@@ -20,7 +37,7 @@ namespace pimii {
 
         for (Looping loop = Looping(table.size(), hash); loop.hasNext(); loop.next()) {
             if (table[loop()] == Nil::NIL) {
-                table[loop()] = mm.makeString(name, symbolType);
+                table.store(loop(), mm.makeString(name, symbolType, &symbolSite));
                 if ( table[loop()].id() == 324) {
                     std::cout << "X";
                 }
@@ -39,8 +56,8 @@ namespace pimii {
     }
 
     void SymbolTable::grow(ObjectPointer table) {
-        ObjectPointer newTable = mm.makeObject(table.size() + 256, table.type());
-        symbolTable[FIELD_TABLE] = newTable;
+        ObjectPointer newTable = mm.makeWeakObject(table.size() + 256, table.type(), &tableSite);
+        symbolTable.store(FIELD_TABLE, newTable);
         for (SmallInteger i = 0; i < table.size(); i++) {
             if (table[i] != Nil::NIL) {
                 reInsert(newTable, table[i]);
@@ -48,12 +65,32 @@ namespace pimii {
         }
     }
 
+    /**
+     * As the table is weak, symbols which are no longer referenced are removed by the GC. This leaves holes in
+     * the probing sequences, therefore all remaining symbols are re-inserted.
+     */
+    void SymbolTable::rehash() {
+        ObjectPointer table = symbolTable[FIELD_TABLE];
+        std::vector<ObjectPointer> symbols;
+        for (SmallInteger i = 0; i < table.size(); i++) {
+            if (table[i] != Nil::NIL) {
+                symbols.push_back(table[i]);
+                table.store(i, Nil::NIL);
+            }
+        }
+
+        symbolTable[FIELD_TALLY] = static_cast<SmallInteger>(symbols.size());
+        for (ObjectPointer symbol : symbols) {
+            reInsert(table, symbol);
+        }
+    }
+
     void SymbolTable::reInsert(ObjectPointer table, ObjectPointer symbol) {
         SmallInteger hash = symbol.hash();
 
         for (Looping loop = Looping(table.size(), hash); loop.hasNext(); loop.next()) {
             if (table[loop()] == Nil::NIL) {
-                table[loop()] = symbol;
+                table.store(loop(), symbol);
                 return;
             }
         }
@@ -19,6 +19,9 @@ namespace pimii {
         static constexpr SmallInteger FIELD_TABLE = 1;
         static constexpr SmallInteger SIZE = 2;
 
+        static AllocationSite tableSite;
+        static AllocationSite symbolSite;
+
         void grow(ObjectPointer table);
 
         void reInsert(ObjectPointer table, ObjectPointer symbol);
@@ -26,8 +29,17 @@ namespace pimii {
     public:
         explicit SymbolTable(MemoryManager &mm);
 
+        /**
+         * Uses the given table (e.g. loaded from an image) which contains symbols of the given type.
+         */
+        SymbolTable(MemoryManager &mm, ObjectPointer symbolType, ObjectPointer symbolTable);
+
+        ~SymbolTable();
+
         ObjectPointer lookup(const std::string_view &name);
 
+        void rehash();
+
         void installTypes(ObjectPointer symbolTableType, ObjectPointer arrayType, ObjectPointer symbolType);
 
         ObjectPointer getSymbolTable() {
@@ -2,10 +2,11 @@
 // Created by Andreas Haufler on 25.11.18.
 //
 
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
 #include "System.h"
 #include "Primitives.h"
-#include "../compiler/Methods.h"
 
 namespace pimii {
 
@@ -214,6 +215,62 @@ namespace pimii {
         inputSemaphore[SEMAPHORE_FIELD_EXCESS_SIGNALS] = 0;
         proc[System::PROCESSOR_FIELD_INPUT_SEMAPHORE] = inputSemaphore;
         dictionary.atPut(symbols.lookup("InputSemaphore"), inputSemaphore);
+
+        ObjectPointer finalizationSemaphore = mm.makeObject(System::SEMAPHORE_SIZE, semaphoreType);
+        finalizationSemaphore[SEMAPHORE_FIELD_EXCESS_SIGNALS] = 0;
+        proc[System::PROCESSOR_FIELD_FINALIZATION_SEMAPHORE] = finalizationSemaphore;
+        dictionary.atPut(symbols.lookup("FinalizationSemaphore"), finalizationSemaphore);
+
+        ObjectPointer lowSpaceSemaphore = mm.makeObject(System::SEMAPHORE_SIZE, semaphoreType);
+        lowSpaceSemaphore[SEMAPHORE_FIELD_EXCESS_SIGNALS] = 0;
+        proc[System::PROCESSOR_FIELD_LOW_SPACE_SEMAPHORE] = lowSpaceSemaphore;
+        dictionary.atPut(symbols.lookup("LowSpaceSemaphore"), lowSpaceSemaphore);
+
+        ObjectPointer snapshotSemaphore = mm.makeObject(System::SEMAPHORE_SIZE, semaphoreType);
+        snapshotSemaphore[SEMAPHORE_FIELD_EXCESS_SIGNALS] = 0;
+        proc[System::PROCESSOR_FIELD_SNAPSHOT_SEMAPHORE] = snapshotSemaphore;
+        dictionary.atPut(symbols.lookup("SnapshotSemaphore"), snapshotSemaphore);
+
+        for (ObjectPointer* root : roots()) {
+            mm.registerRoot(*root);
+        }
+    }
+
+    System::System(const std::vector<ObjectPointer>& imageRoots)
+            : mm(), symbols(mm, imageRoots.at(IMAGE_ROOT_SYMBOL_TYPE), imageRoots.at(IMAGE_ROOT_SYMBOL_TABLE)),
+              dictionary(mm, imageRoots.at(IMAGE_ROOT_ASSOCIATION_TYPE), imageRoots.at(IMAGE_ROOT_DICTIONARY)) {
+        std::vector<ObjectPointer*> fields = roots();
+        if (imageRoots.size() != IMAGE_ROOT_FIELDS + fields.size()) {
+            throw std::runtime_error("The image doesn't match this VM!");
+        }
+
+        for (size_t index = 0; index < fields.size(); index++) {
+            *fields[index] = imageRoots[IMAGE_ROOT_FIELDS + index];
+            mm.registerRoot(*fields[index]);
+        }
+    }
+
+    std::vector<ObjectPointer> System::imageRoots() {
+        std::vector<ObjectPointer> result = {symbolType, symbols.getSymbolTable(), associationType,
+                                             dictionary.getDictionary()};
+        for (ObjectPointer* root : roots()) {
+            result.push_back(*root);
+        }
+
+        return result;
+    }
+
+    System::~System() {
+        for (ObjectPointer* root : roots()) {
+            mm.unregisterRoot(*root);
+        }
+    }
+
+    std::vector<ObjectPointer*> System::roots() {
+        return {&nilType, &metaClassType, &classType, &objectType, &smallIntType, &symbolType, &stringType,
+                &associationType, &arrayType, &byteArrayType, &methodContextType, &blockContextType,
+                &compiledMethodType, &linkType, &processType, &inputEventType, &pointType, &characterType,
+                &trueValue, &falseValue, &proc, &specialSelectorArray};
     }
 
 
@@ -258,6 +315,33 @@ namespace pimii {
         return -1;
     }
 
+    void System::printCensus(std::ostream& out, size_t limit) {
+        std::vector<ClassCensus> census = mm.census();
+        std::vector<size_t> classes;
+        for (size_t index = 0; index < census.size(); index++) {
+            if (census[index].instances > 0) {
+                classes.push_back(index);
+            }
+        }
+
+        std::sort(classes.begin(), classes.end(),
+                  [&census](size_t left, size_t right) { return census[left].bytes > census[right].bytes; });
+
+        out << std::setw(12) << "Instances" << std::setw(16) << "Bytes" << "  Class" << std::endl;
+        for (size_t i = 0; i < std::min(limit, classes.size()); i++) {
+            ObjectPointer type = ObjectPointer::classTable[classes[i]];
+            out << std::setw(12) << census[classes[i]].instances << std::setw(16) << census[classes[i]].bytes << "  "
+                << (type == Nil::NIL ? "?" : type[TYPE_FIELD_NAME].stringView()) << std::endl;
+        }
+    }
+
+    void System::writeHeapDump(std::ostream& out) {
+        mm.writeHeapDump(out, [](ObjectPointer type) -> std::string_view {
+            ObjectPointer name = type[TYPE_FIELD_NAME];
+            return name.isBuffer() ? name.stringView() : "?";
+        });
+    }
+
     bool System::is(ObjectPointer instance, ObjectPointer expectedType) {
         if (expectedType.type() != metaClassType) {
             //TODO
@@ -7,6 +7,7 @@
 
 #include <bitset>
 #include <mutex>
+#include <ostream>
 
 #include "../mem/MemoryManager.h"
 #include "SymbolTable.h"
@@ -44,6 +45,18 @@ namespace pimii {
 
         ObjectPointer specialSelectorArray;
 
+        std::vector<ObjectPointer*> roots();
+
+        /**
+         * An image stores the tables of the SymbolTable and the SystemDictionary along with their types, followed
+         * by all roots.
+         */
+        static constexpr size_t IMAGE_ROOT_SYMBOL_TYPE = 0;
+        static constexpr size_t IMAGE_ROOT_SYMBOL_TABLE = 1;
+        static constexpr size_t IMAGE_ROOT_ASSOCIATION_TYPE = 2;
+        static constexpr size_t IMAGE_ROOT_DICTIONARY = 3;
+        static constexpr size_t IMAGE_ROOT_FIELDS = 4;
+
         void
         completeType(ObjectPointer type, ObjectPointer superType, const std::string& name,
                      SmallInteger effectiveFixedClassFields, SmallInteger effectiveFixedFields);
@@ -56,14 +69,18 @@ namespace pimii {
         static constexpr SmallInteger TYPE_FIELD_TALLY = 4;
         static constexpr SmallInteger TYPE_FIELD_SELECTORS = 5;
         static constexpr SmallInteger TYPE_FIELD_METHODS = 6;
-        static constexpr SmallInteger TYPE_SIZE = 7;
+        static constexpr SmallInteger TYPE_FIELD_CLASS_INDEX = ObjectPointer::TYPE_FIELD_CLASS_INDEX;
+        static constexpr SmallInteger TYPE_SIZE = 8;
 
         static constexpr SmallInteger PROCESSOR_FIELD_ACTIVE_PROCESS = 0;
         static constexpr SmallInteger PROCESSOR_FIELD_TIMER_SEMAPHORE = 1;
         static constexpr SmallInteger PROCESSOR_FIELD_INPUT_SEMAPHORE = 2;
         static constexpr SmallInteger PROCESSOR_FIELD_FIRST_WAITING_PROCESS = 3;
         static constexpr SmallInteger PROCESSOR_FIELD_LAST_WAITING_PROCESS = 4;
-        static constexpr SmallInteger PROCESSOR_SIZE = 5;
+        static constexpr SmallInteger PROCESSOR_FIELD_FINALIZATION_SEMAPHORE = 5;
+        static constexpr SmallInteger PROCESSOR_FIELD_LOW_SPACE_SEMAPHORE = 6;
+        static constexpr SmallInteger PROCESSOR_FIELD_SNAPSHOT_SEMAPHORE = 7;
+        static constexpr SmallInteger PROCESSOR_SIZE = 8;
 
         static constexpr SmallInteger PROCESS_FIELD_CONTEXT = 0;
         static constexpr SmallInteger PROCESS_FIELD_TIME = 1;
@@ -78,12 +95,13 @@ namespace pimii {
         static constexpr SmallInteger LINK_NEXT = 1;
         static constexpr SmallInteger LINK_SIZE = 2;
 
-        static constexpr SmallInteger COMPILED_METHOD_SIZE = 4;
+        static constexpr SmallInteger COMPILED_METHOD_SIZE = 5;
         static constexpr SmallInteger COMPILED_METHOD_FIELD_HEADER = 0;
         static constexpr SmallInteger COMPILED_METHOD_FIELD_OPCODES = 1;
         static constexpr SmallInteger COMPILED_METHOD_FIELD_OWNER = 2;
         static constexpr SmallInteger COMPILED_METHOD_FIELD_SELECTOR = 3;
-        static constexpr SmallInteger COMPILED_METHOD_FIELD_LITERALS_START = 4;
+        static constexpr SmallInteger COMPILED_METHOD_FIELD_SEND_SITES = 4;
+        static constexpr SmallInteger COMPILED_METHOD_FIELD_LITERALS_START = 5;
         static constexpr SmallInteger COMPILED_METHOD_TYPE_FIELD_SPECIAL_SELECTORS = TYPE_SIZE;
 
         static constexpr SmallInteger CONTEXT_FIXED_SIZE = 6;
@@ -166,6 +184,19 @@ namespace pimii {
 
         System();
 
+        /**
+         * Restores the system from the roots of an image (see imageRoots and MemoryManager::imageRoots) instead of
+         * bootstrapping all classes.
+         */
+        explicit System(const std::vector<ObjectPointer>& imageRoots);
+
+        ~System();
+
+        /**
+         * Returns all objects required to restore the system from an image (see MemoryManager::saveImage).
+         */
+        std::vector<ObjectPointer> imageRoots();
+
         ObjectPointer makeType(ObjectPointer parent, const std::string& name, SmallInteger effectiveFixedFields,
                                SmallInteger effectiveFixedClassFields);
 
@@ -217,6 +248,10 @@ namespace pimii {
             return linkType;
         };
 
+        ObjectPointer typeAssociation() {
+            return associationType;
+        };
+
         ObjectPointer typePoint() {
             return pointType;
         };
@@ -270,6 +305,16 @@ namespace pimii {
 
         bool is(ObjectPointer instance, ObjectPointer type);
 
+        /**
+         * Prints the given number of classes which occupy the most bytes in the heap (see MemoryManager::census).
+         */
+        void printCensus(std::ostream& out, size_t limit);
+
+        /**
+         * Writes a heap dump (see MemoryManager::writeHeapDump) which resolves class names via TYPE_FIELD_NAME.
+         */
+        void writeHeapDump(std::ostream& out);
+
     };
 
 }
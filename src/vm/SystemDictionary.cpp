@@ -8,10 +8,27 @@
 
 namespace pimii {
 
+    AllocationSite SystemDictionary::tableSite;
+    AllocationSite SystemDictionary::associationSite;
+
     SystemDictionary::SystemDictionary(MemoryManager &mm) : mm(mm), associationType(Nil::NIL), dictionary(
             mm.makeRootObject(System::DICTIONARY_SIZE, Nil::NIL)) {
         dictionary[System::DICTIONARY_FIELD_TALLY] = 0;
         dictionary[System::DICTIONARY_FIELD_TABLE] = mm.makeObject(512, Nil::NIL);
+
+        mm.registerRoot(associationType);
+        mm.registerRoot(dictionary);
+    }
+
+    SystemDictionary::SystemDictionary(MemoryManager &mm, ObjectPointer associationType, ObjectPointer dictionary)
+            : mm(mm), associationType(associationType), dictionary(dictionary) {
+        mm.registerRoot(this->associationType);
+        mm.registerRoot(this->dictionary);
+    }
+
+    SystemDictionary::~SystemDictionary() {
+        mm.unregisterRoot(associationType);
+        mm.unregisterRoot(dictionary);
     }
 
     ObjectPointer SystemDictionary::atPut(ObjectPointer key, ObjectPointer value, bool force) {
@@ -20,10 +37,10 @@ namespace pimii {
         for (Looping loop = Looping(table.size(), key.id()); loop.hasNext(); loop.next()) {
             ObjectPointer association = table[loop()];
             if (association == Nil::NIL) {
-                ObjectPointer newAssociation = mm.makeObject(System::ASSOCIATION_SIZE, associationType);
+                ObjectPointer newAssociation = mm.makeObject(System::ASSOCIATION_SIZE, associationType, &associationSite);
                 newAssociation[System::ASSOCIATION_FIELD_KEY] = key;
                 newAssociation[System::ASSOCIATION_FIELD_VALUE] = value;
-                table[loop()] = ObjectPointer(newAssociation);
+                table.store(loop(), ObjectPointer(newAssociation));
 
                 SmallInteger newSize = dictionary[System::DICTIONARY_FIELD_TALLY].smallInt() + 1;
                 dictionary[System::DICTIONARY_FIELD_TALLY] = newSize;
@@ -33,7 +50,7 @@ namespace pimii {
                 return newAssociation;
             } else if (association[System::ASSOCIATION_FIELD_KEY] == key) {
                 if (force) {
-                    association[System::ASSOCIATION_FIELD_VALUE] = value;
+                    association.store(System::ASSOCIATION_FIELD_VALUE, value);
                 }
                 return association;
             }
@@ -47,8 +64,8 @@ namespace pimii {
     }
 
     void SystemDictionary::grow(ObjectPointer table) {
-        ObjectPointer newTable = mm.makeObject(table.size() + 256, table.type());
-        dictionary[System::DICTIONARY_FIELD_TABLE] = newTable;
+        ObjectPointer newTable = mm.makeObject(table.size() + 256, table.type(), &tableSite);
+        dictionary.store(System::DICTIONARY_FIELD_TABLE, newTable);
 
         for (SmallInteger i = 0; i < table.size(); i++) {
             if (table[i] != Nil::NIL) {
@@ -62,7 +79,7 @@ namespace pimii {
 
         for (Looping loop = Looping(table.size(), key.id()); loop.hasNext(); loop.next()) {
             if (table[loop()] == Nil::NIL) {
-                table[loop()] = association;
+                table.store(loop(), association);
                 return;
             }
         }
@@ -15,6 +15,9 @@ namespace pimii {
         ObjectPointer associationType;
         ObjectPointer dictionary;
 
+        static AllocationSite tableSite;
+        static AllocationSite associationSite;
+
         ObjectPointer atPut(ObjectPointer key, ObjectPointer value, bool force);
 
         void grow(ObjectPointer table);
@@ -25,6 +28,13 @@ namespace pimii {
 
         explicit SystemDictionary(MemoryManager &mm);
 
+        /**
+         * Uses the given dictionary (e.g. loaded from an image) which stores associations of the given type.
+         */
+        SystemDictionary(MemoryManager &mm, ObjectPointer associationType, ObjectPointer dictionary);
+
+        ~SystemDictionary();
+
         ObjectPointer getDictionary() {
             return dictionary;
         }